@@ -31,14 +31,46 @@
 /*
  * we require sharp inequalities here, as otherwise we could end (after
  * reading) with got == did, and that implies empty buffer
+ *
+ * buf_can_r() may only be called by the reader, or by the writer while the
+ * reader is known to be asleep (see transfer_writer()); analogously for
+ * buf_can_w()
  */
+static inline size_t
+ibuf_emp(const struct buf_s *restrict buf)
+{
+	size_t emp = (buf->did_r - buf->got) & buf->mask;
+	return likely(emp) ? emp : buf->size;
+}
+
+/* the reader's end of the free space - see chk in buffer.h */
+static inline size_t
+ibuf_tail(const struct buf_s *restrict buf)
+{
+	size_t did = load_acq(buf->did), chk;
+
+	if likely(!(buf->flags & M_CRCT))
+		return did;
+	chk = load_acq(buf->chk);
+	return ((buf->got - chk) & buf->mask) > ((buf->got - did) & buf->mask) ? chk : did;
+}
+
+static inline size_t
+ibuf_hav(const struct buf_s *restrict buf)
+{
+	return (buf->got_w - buf->did - buf->gift) & buf->mask;
+}
+
 size_t buf_can_r(struct buf_s *restrict buf)
 {
 	size_t emp;
 
-	emp = (buf->did - buf->got) & buf->mask;
-	if unlikely(!emp)
-		emp = buf->size;
+	/* refresh the shadow of did only if it's not enough for a full block */
+	emp = ibuf_emp(buf);
+	if unlikely(emp <= buf->rblk || buf->rstall) {
+		buf->did_r = ibuf_tail(buf);
+		emp = ibuf_emp(buf);
+	}
 
 	if unlikely(buf->rstall) {
 		/* hav = (~emp + 1) & mask; equivalent of hav > buf->rsp */
@@ -51,8 +83,9 @@ size_t buf_can_r(struct buf_s *restrict buf)
 	}
 	if likely(emp > buf->rblk)
 		return buf->rblk;
+	/* emp - 1, so we never fill the buffer completely (byte mode) */
 	if likely(emp > buf->rmin)
-		return emp;
+		return emp - 1;
 	if unlikely(buf->rsp) {
 		/* overrun, back off */
 		buf->rstall = 1;
@@ -61,11 +94,95 @@ size_t buf_can_r(struct buf_s *restrict buf)
 	return 0;
 }
 
+/*
+ * free space past the reservations - got is advanced by the committing
+ * reader, possibly on another thread; only full blocks are reserved, and
+ * there are no stalls (-p) in this mode
+ */
+size_t buf_can_rs(struct buf_s *restrict buf)
+{
+	size_t got, emp, out;
+
+	got = load_acq(buf->got);
+	out = (buf->res - got) & buf->mask;
+	emp = (buf->did_r - got) & buf->mask;
+	if (!emp)
+		emp = buf->size;
+	if unlikely(emp <= out + buf->rblk) {
+		buf->did_r = ibuf_tail(buf);
+		emp = (buf->did_r - got) & buf->mask;
+		if (!emp)
+			emp = buf->size;
+	}
+	return emp > out + buf->rblk ? buf->rblk : 0;
+}
+
+/*
+ * checksum task - everything committed by the reader past chk, up to cnt
+ * reader's blocks (so the space goes back to it in small steps)
+ */
+size_t buf_can_cn(struct buf_s *restrict buf, size_t cnt)
+{
+	size_t hav;
+
+	hav = (buf->got_c - buf->chk) & buf->mask;
+	if (hav < cnt * buf->rblk) {
+		buf->got_c = load_acq(buf->got);
+		hav = (buf->got_c - buf->chk) & buf->mask;
+	}
+	return Y_MIN(hav, cnt * buf->rblk);
+}
+
+size_t buf_can_c(struct buf_s *restrict buf)
+{
+	return buf_can_cn(buf, 1);
+}
+
+/* checksum task is done - its crc becomes the reader's one */
+void buf_crct_fin(struct buf_s *restrict buf)
+{
+	buf->rdg = buf->cdg;
+}
+
+/*
+ * data past the writers' reservations - full blocks only, the remainder is
+ * left to the regular epilogue
+ */
+size_t buf_can_ws(struct buf_s *restrict buf)
+{
+	size_t hav;
+
+	hav = (buf->got_w - buf->wres) & buf->mask;
+	if unlikely(hav < buf->wblk) {
+		buf->got_w = load_acq(buf->got);
+		hav = (buf->got_w - buf->wres) & buf->mask;
+	}
+	return hav >= buf->wblk ? buf->wblk : 0;
+}
+
+/*
+ * parity mode - as above, but the data is limited by the parity cursor; par
+ * never passes got, so it's also a valid (if older) shadow of it
+ */
+size_t buf_can_wp(struct buf_s *restrict buf)
+{
+	size_t hav;
+
+	buf->got_w = load_acq(buf->par);
+	hav = (buf->got_w - buf->wres) & buf->mask;
+	return hav >= buf->wblk ? buf->wblk : 0;
+}
+
 size_t buf_can_w(struct buf_s * restrict buf)
 {
 	size_t hav;
 
-	hav = (buf->got - buf->did) & buf->mask;
+	/* refresh the shadow of got only if it's not enough for a full block */
+	hav = ibuf_hav(buf);
+	if unlikely(hav < buf->wblk || buf->wstall) {
+		buf->got_w = load_acq(buf->got);
+		hav = ibuf_hav(buf);
+	}
 
 	if unlikely(buf->wstall) {
 		if likely(hav < buf->wsp)
@@ -87,12 +204,53 @@ size_t buf_can_w(struct buf_s * restrict buf)
 	return 0;
 }
 
+/*
+ * batched variants - if a full block can be transferred, extend the chunk to
+ * as many full blocks as the buffer allows, up to cnt (in byte mode - to all
+ * available space or data, up to cnt blocks); a refresh of the shadow cursor
+ * is done only if the cached value is not enough for the whole batch
+ */
+size_t buf_can_rn(struct buf_s *restrict buf, size_t cnt)
+{
+	size_t siz, emp;
+
+	siz = buf_can_r(buf);
+	if (likely(cnt <= 1) || siz < buf->rblk)
+		return siz;
+	emp = ibuf_emp(buf);
+	if (emp <= cnt * buf->rblk) {
+		buf->did_r = ibuf_tail(buf);
+		emp = ibuf_emp(buf);
+	}
+	/* see buf_can_r() about the sharp inequality */
+	emp--;
+	if (buf->flags & M_LINER)
+		return Y_MIN(emp, cnt * buf->rblk);
+	return Y_MIN(emp / buf->rblk, cnt) * buf->rblk;
+}
+
+size_t buf_can_wn(struct buf_s *restrict buf, size_t cnt)
+{
+	size_t siz, hav;
+
+	siz = buf_can_w(buf);
+	if (likely(cnt <= 1) || siz < buf->wblk)
+		return siz;
+	hav = ibuf_hav(buf);
+	if (hav < cnt * buf->wblk) {
+		buf->got_w = load_acq(buf->got);
+		hav = ibuf_hav(buf);
+	}
+	if (buf->flags & M_LINEW)
+		return Y_MIN(hav, cnt * buf->wblk);
+	return Y_MIN(hav / buf->wblk, cnt) * buf->wblk;
+}
+
 void buf_dt(struct buf_s *buf)
 {
 	if (!buf)
 		return;
 	shmw_dt(&buf->buf);
-	shmw_dt(&buf->scr);
 }
 
 void buf_dtor(struct buf_s *buf)
@@ -100,14 +258,13 @@ void buf_dtor(struct buf_s *buf)
 	if (!buf)
 		return;
 	shmw_dtor(&buf->buf);
-	shmw_dtor(&buf->scr);
 	memset(buf, 0, sizeof *buf);
 }
 
 int buf_ctor(struct buf_s *buf, size_t bsiz, size_t rblk, size_t wblk, size_t hpage)
 {
 	int ret, idx;
-	size_t csiz, page = get_page(), blk;
+	size_t page = get_page(), blk;
 
 	if (!buf) {
 		fputs("buf: no buf ?\n", stderr);
@@ -145,14 +302,10 @@ int buf_ctor(struct buf_s *buf, size_t bsiz, size_t rblk, size_t wblk, size_t hp
 		goto out;
 	}
 
-	csiz = Y_ALIGN(rblk, page) + Y_ALIGN(wblk, page);
-	if (shmw_ctor(&buf->scr, "/yancat-bounce-area", &csiz, 0, 0, 0) < 0) {
-		fputs("buf: failed to allocate shared memory bounce area\n", stderr);
-		goto out;
-	}
-	buf->rchunk = shmw_ptr(&buf->scr);
-	buf->wchunk = buf->rchunk + Y_ALIGN(rblk, page);
-
+	/*
+	 * note: no bounce areas are needed - if the buffer is not circular,
+	 * chunks wrapping around its end are passed as 2 iovecs
+	 */
 	buf->rblk = rblk;
 	buf->wblk = wblk;
 	return ret;
@@ -161,36 +314,6 @@ out:
 	return -1;
 }
 
-void ibuf_commit_rbounce(struct buf_s *restrict buf, size_t chunk)
-{
-	size_t siz1, siz2;
-
-	/* we can't assume we're at the edge, as read may return less (even if buf_fetch_r() checked for it) */
-	siz1 = Y_MIN(buf->size - buf->got, chunk);
-	siz2 = chunk - siz1;
-	memcpy(buf->ptr + buf->got, buf->rchunk, siz1);
-	if likely(siz2)
-		memcpy(buf->ptr, buf->rchunk + siz1, siz2);
-
-	if unlikely(buf->dorcrc)
-		buf->rcrc = crc_calc(buf->rcrc, buf->rchunk, chunk);
-}
-
-/* fetch can be forced, we can't assume that it's at the edge */
-uint8_t *ibuf_fetch_wbounce(struct buf_s *restrict buf, size_t chunk)
-{
-	size_t siz1, siz2;
-
-	siz1 = Y_MIN(buf->size - buf->did, chunk);
-	siz2 = chunk - siz1;
-	memcpy(buf->wchunk, buf->ptr + buf->did, siz1);
-	if likely(siz2)
-		memcpy(buf->wchunk + siz1, buf->ptr, siz2);
-
-	buf->fastw = 0;
-	return buf->wchunk;
-}
-
 void buf_setlinew(struct buf_s *buf)
 {
 	buf->flags |= M_LINEW;
@@ -203,7 +326,7 @@ void buf_setlinew(struct buf_s *buf)
 	buf->wstall = 0;
 }
 
-int buf_setextra(struct buf_s *buf, int rline, int wline, int rcrc, int wcrc, double rs, double ws)
+int buf_setextra(struct buf_s *buf, int rline, int wline, int rcrc, int wcrc, int dgst, double rs, double ws)
 {
 	size_t rsp, wsp;
 	if (rline) {
@@ -219,11 +342,11 @@ int buf_setextra(struct buf_s *buf, int rline, int wline, int rcrc, int wcrc, do
 		buf->wmin = buf->wblk;
 
 	if (rcrc) {
-		buf->rcrc = crc_beg();
+		dg_beg(&buf->rdg, dgst);
 		buf->dorcrc = 1;
 	}
 	if (wcrc) {
-		buf->wcrc = crc_beg();
+		dg_beg(&buf->wdg, dgst);
 		buf->dowcrc = 1;
 	}
 	rsp = (size_t)(0.5 + rs*(double)buf->size);
@@ -266,30 +389,50 @@ int buf_setextra(struct buf_s *buf, int rline, int wline, int rcrc, int wcrc, do
 	return 0;
 }
 
-static void rep_crc(int c, CRCINT _crc, unsigned long long cnt)
+static void rep_crc(int c, const struct dg_s *dg, unsigned long long cnt)
 {
 	unsigned long long int crc, cks;
-	crc = crc_end(_crc);
-	cks = crc_end(crc_cksum(_crc, cnt));
+	char str[DG_STRLEN];
+
+	if (dg->type != DG_CRC32) {
+		dg_end(dg, str);
+		fprintf(stderr, "  %c%s: %s\n", c, dg_name(dg->type), str);
+		return;
+	}
+	crc = crc_end(dg->u.crc);
+	cks = crc_end(crc_cksum(dg->u.crc, cnt));
 	fprintf (stderr,
 		"  %ccrc:  0x%llx; %ccksum: %llu (0x%llx)\n",
 		c, crc, c, cks, cks
 	);
 }
 
+/*
+ * the input's crc is taken by the checksum task instead of the reader; must
+ * follow buf_setextra()
+ */
+void buf_setcrct(struct buf_s *buf)
+{
+	buf->flags |= M_CRCT;
+	buf->cdg = buf->rdg;
+	buf->dorcrc = 0;
+}
+
 void buf_report_stats(struct buf_s * restrict buf)
 {
 	fprintf (stderr,
 		"Buffer stats:\n"
-		"  read:  %llu (%llu%c blocks)\n"
-		"  wrote: %llu (%llu%c blocks)\n",
-		buf->allin,  buf->allin / buf->rblk,  buf->allin  % buf->rblk ? '+':' ',
-		buf->allout, buf->allout / buf->wblk, buf->allout % buf->wblk ? '+':' '
+		"  read:  %llu (%llu%c blocks, %llu calls)\n"
+		"  wrote: %llu (%llu%c blocks, %llu calls)\n",
+		buf->allin,  buf->allin / buf->rblk,  buf->allin  % buf->rblk ? '+':' ', buf->rops,
+		buf->allout, buf->allout / buf->wblk, buf->allout % buf->wblk ? '+':' ', buf->wops
 	);
-	if (buf->dorcrc)
-		rep_crc('r', buf->rcrc, buf->allin);
+	if (buf->path)
+		fprintf (stderr, "  via:   %s\n", buf->path);
+	if (buf->dorcrc || buf->flags & M_CRCT)
+		rep_crc('r', &buf->rdg, buf->allin);
 	if (buf->dowcrc)
-		rep_crc('w', buf->wcrc, buf->allout);
+		rep_crc('w', &buf->wdg, buf->allout);
 }
 
 void buf_report_init(struct buf_s * restrict buf)
@@ -313,4 +456,8 @@ void buf_report_init(struct buf_s * restrict buf)
 		buf->flags & M_CIR ? "yes" : "no",
 		buf->flags & M_HUGE ? "yes" : "no"
 	);
+	if (buf->dorcrc || buf->dowcrc || buf->flags & M_CRCT) {
+		int t = buf->dowcrc ? buf->wdg.type : buf->rdg.type;
+		fprintf(stderr, "  digest:       %s (%s)%s\n", dg_name(t), dg_impl(t), buf->flags & M_CRCT ? ", input in a separate task" : "");
+	}
 }
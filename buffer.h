@@ -21,8 +21,10 @@
 #define __buffer_h__
 
 #include <stdint.h>
+#include <string.h>
 #include "common.h"
 #include "crc.h"
+#include "digest.h"
 #include "shmw.h"
 
 #define M_LINER 0x01
@@ -30,113 +32,250 @@
 #define M_HUGE  0x04
 #define M_SHM   0x08
 #define M_CIR   0x10
+#define M_CRCT  0x20
 
+/*
+ * the structure is split into 3 parts, each starting at its own cache line:
+ * - read-only (after setup) part, shared by both sides
+ * - reader owned part
+ * - writer owned part
+ * so the reader and the writer (possibly on different cpus) don't bounce the
+ * same cache lines with every commit; did_r and got_w are the sides' local
+ * (shadow) copies of the other side's cursor, refreshed only when the cached
+ * value doesn't provide enough space / data (see buf_can_[rw]())
+ *
+ * path is set by the engines moving the data outside of the buffer (for the
+ * final report only)
+ *
+ * gift is the amount of data already written past did, but not yet released
+ * to the reader (see buf_commit_wg()); it's always 0 in regular mode
+ *
+ * res / wres are the ends of the space reserved by parallel readers / writers
+ * (see buf_reserve_[rw]()); they're not used otherwise
+ *
+ * par is the end of the data already covered by the parity of a striped
+ * output (-R) - the parity thread trails the reader, and the writers trail the
+ * parity thread (see buf_can_wp()); it's not used otherwise
+ *
+ * chk is the cursor of the checksum task (-E, M_CRCT) - it trails the reader
+ * just like did does, computing the input's crc into ccrc; the reader's space
+ * ends at whichever of the two is further behind, so no data is released
+ * before both the writer and the checksummer are done with it (got_c is the
+ * task's shadow of got)
+ *
+ * rdg / wdg / cdg are the digests (-x, crc32 by default) of the reader, the
+ * writer and the checksum task
+ */
 struct buf_s {
-	struct shm_s buf, scr; /* buf and bounce areas */
-	uint8_t *ptr, *rchunk, *wchunk;
+	struct shm_s buf;
+	uint8_t *ptr;
 	size_t size, mask;
-	size_t got, did;
 	size_t rblk, wblk, rmin, wmin, rsp, rsp_inv, wsp;
-	int fastr, fastw, flags, dorcrc, dowcrc, iscir, wstall, rstall;
-	unsigned long long int allin, allout;
-	CRCINT rcrc, wcrc;
+	int flags, dorcrc, dowcrc, iscir;
+	const char *path;
+	struct {
+		size_t got, did_r, res;
+		int rstall;
+		unsigned long long int allin, rops;
+		struct dg_s rdg;
+	} cline_aligned;
+	struct {
+		size_t did, got_w, gift, wres, par;
+		int wstall;
+		unsigned long long int allout, wops;
+		struct dg_s wdg;
+	} cline_aligned;
+	struct {
+		size_t chk, got_c;
+		struct dg_s cdg;
+	} cline_aligned;
 };
 
-void ibuf_commit_rbounce(struct buf_s *restrict buf, size_t chunk);
-uint8_t * ibuf_fetch_wbounce(struct buf_s * restrict buf, size_t chunk);
-
 /*
+ * ring api - fetch functions describe the next chunk of the buffer with 1 or 2
+ * iovecs (the latter only if the buffer is not circular and the chunk wraps
+ * around its end), suitable for readv() / writev() family of calls
+ *
  * on mingw we support only subset of full functionality - among those there's
  * no possibility for circular buffer; OTOH on any unix it's almost guaranteed
  */
-static inline uint8_t *
-buf_fetch_r(struct buf_s *restrict buf, size_t chunk)
+static inline int
+ibuf_iov(const struct buf_s *restrict buf, struct iovec *iov, size_t pos, size_t chunk)
 {
+	size_t siz1;
+
+	iov[0].iov_base = buf->ptr + pos;
 #ifdef h_mingw
-	if (likely(buf->got + chunk <= buf->size) || buf->iscir) {
+	if (likely(pos + chunk <= buf->size) || buf->iscir) {
 #else
-	if (likely(buf->iscir) || buf->got + chunk <= buf->size) {
+	if (likely(buf->iscir) || pos + chunk <= buf->size) {
 #endif
-		buf->fastr = 1;
-		return buf->ptr + buf->got;
-	} else {
-		buf->fastr = 0;
-		return buf->rchunk;
+		iov[0].iov_len = chunk;
+		return 1;
 	}
+	siz1 = buf->size - pos;
+	iov[0].iov_len = siz1;
+	iov[1].iov_base = buf->ptr;
+	iov[1].iov_len = chunk - siz1;
+	return 2;
 }
 
-/* see comment above */
-static inline uint8_t *
-buf_fetch_w(struct buf_s * restrict buf, size_t chunk)
+static inline CRCINT
+ibuf_crc(const struct buf_s *restrict buf, CRCINT crc, size_t pos, size_t chunk)
 {
-#ifdef h_mingw
-	if (likely(buf->did + chunk <= buf->size) || buf->iscir) {
-#else
-	if (likely(buf->iscir) || buf->did + chunk <= buf->size) {
-#endif
-		buf->fastw = 1;
-		return buf->ptr + buf->did;
-	} else
-		return ibuf_fetch_wbounce(buf, chunk);
+	struct iovec iov[2];
+	int i, cnt;
+
+	cnt = ibuf_iov(buf, iov, pos, chunk);
+	for (i = 0; i < cnt; i++)
+		crc = crc_calc(crc, iov[i].iov_base, iov[i].iov_len);
+	return crc;
+}
+
+static inline void
+ibuf_dg(const struct buf_s *restrict buf, struct dg_s *restrict dg, size_t pos, size_t chunk)
+{
+	struct iovec iov[2];
+	int i, cnt;
+
+	cnt = ibuf_iov(buf, iov, pos, chunk);
+	for (i = 0; i < cnt; i++)
+		dg_calc(dg, iov[i].iov_base, iov[i].iov_len);
+}
+
+static inline int
+buf_fetch_r(const struct buf_s *restrict buf, struct iovec *iov, size_t chunk)
+{
+	return ibuf_iov(buf, iov, buf->got, chunk);
+}
+
+static inline int
+buf_fetch_w(const struct buf_s *restrict buf, struct iovec *iov, size_t chunk)
+{
+	return ibuf_iov(buf, iov, (buf->did + buf->gift) & buf->mask, chunk);
+}
+
+/*
+ * strict mode epilogue - pad the last, partial block with 0s in the buffer
+ * itself, right after the data (free space is guaranteed to be larger than
+ * wblk); the pad is never committed with buf_commit_wf()
+ */
+static inline int
+buf_fetchpad_w(struct buf_s *restrict buf, struct iovec *iov, size_t chunk, size_t pad)
+{
+	struct iovec piov[2];
+	int i, cnt;
+
+	size_t pos = (buf->did + buf->gift) & buf->mask;
+
+	cnt = ibuf_iov(buf, piov, (pos + chunk) & buf->mask, pad);
+	for (i = 0; i < cnt; i++)
+		memset(piov[i].iov_base, 0, piov[i].iov_len);
+	return ibuf_iov(buf, iov, pos, chunk + pad);
+}
+
+/*
+ * checksum task - the crc is taken in place (c), then the space is handed back
+ * to the reader with chk (cf)
+ */
+static inline void
+buf_commit_c(struct buf_s *restrict buf, size_t chunk)
+{
+	ibuf_dg(buf, &buf->cdg, buf->chk, chunk);
 }
 
-static inline uint8_t *
-buf_forcefetch_w(struct buf_s * restrict buf, size_t chunk)
+static inline void
+buf_commit_cf(struct buf_s *restrict buf, size_t chunk)
 {
-	return ibuf_fetch_wbounce(buf, chunk);
+	store_rel(buf->chk, (buf->chk + chunk) & buf->mask);
 }
 
 static inline void
 buf_commit_r(struct buf_s *restrict buf, size_t chunk)
 {
 	buf->allin += chunk;
-	if likely(buf->fastr) {
-		if unlikely(buf->dorcrc)
-			buf->rcrc = crc_calc(buf->rcrc, buf->ptr + buf->got, chunk);
-	} else
-		ibuf_commit_rbounce(buf, chunk);
+	buf->rops++;
+	if unlikely(buf->dorcrc)
+		ibuf_dg(buf, &buf->rdg, buf->got, chunk);
 }
 
 static inline void
 buf_commit_w(struct buf_s * restrict buf, size_t chunk)
 {
 	buf->allout += chunk;
-	if unlikely(buf->dowcrc) {
-		if likely(buf->fastw) {
-			buf->wcrc = crc_calc(buf->wcrc, buf->ptr + buf->did, chunk);
-		} else {
-			buf->wcrc = crc_calc(buf->wcrc, buf->wchunk, chunk);
-		}
-	}
+	buf->wops++;
+	if unlikely(buf->dowcrc)
+		ibuf_dg(buf, &buf->wdg, (buf->did + buf->gift) & buf->mask, chunk);
 }
-#if 0
+
+/*
+ * commit functions are split into r/rf and w/wf; .f versions publish the new
+ * cursor to the other side
+ *
+ * got is written only by the reader, did only by the writer (single producer,
+ * single consumer); the owner publishes its cursor with release semantics
+ * after the data (or the space) is ready, and the other side picks it up with
+ * acquire semantics in buf_can_r/w() - so no locking is needed around them
+ */
 static inline void
-buf_crc_w(struct buf_s * restrict buf, const uint8_t * restrict ptr, size_t chunk)
+buf_commit_rf(struct buf_s *restrict buf, size_t chunk)
 {
-	buf->wcrc = crc_calc(buf->wcrc, ptr, chunk);
+	store_rel(buf->got, (buf->got + chunk) & buf->mask);
 }
 
 static inline void
-buf_crc_r(struct buf_s * restrict buf, const uint8_t * restrict ptr, size_t chunk)
+buf_commit_wf(struct buf_s *restrict buf, size_t chunk)
 {
-	buf->rcrc = crc_calc(buf->rcrc, ptr, chunk);
+	store_rel(buf->did, (buf->did + chunk) & buf->mask);
 }
-#endif
+
 /*
- * commit functions are split into r/rf and w/wf, because .f versions
- * modify values and we have no guarantees about atomicity - at the same time
- * funcions making decisions (buf_can_r/w) would be reading those values
+ * gift mode - the data was handed over to the kernel by reference (see
+ * vmsplice(2)), so the space can't be given back to the reader until its
+ * pages are replaced with fresh ones; wg moves the writer's position only, wr
+ * releases the oldest part of the gifted data
  */
 static inline void
-buf_commit_rf(struct buf_s *restrict buf, size_t chunk)
+buf_commit_wg(struct buf_s *restrict buf, size_t chunk)
 {
-	buf->got = (buf->got + chunk) & buf->mask;
+	buf->gift += chunk;
 }
 
 static inline void
-buf_commit_wf(struct buf_s *restrict buf, size_t chunk)
+buf_commit_wr(struct buf_s *restrict buf, size_t chunk)
+{
+	buf->gift -= chunk;
+	buf_commit_wf(buf, chunk);
+}
+
+/*
+ * parallel readers - chunks past got are reserved in order (res marks the end
+ * of the reservations), filled in any order, and then committed with
+ * buf_commit_r/rf() strictly in the order of reservation; the caller
+ * serializes reservations (buf_can_rs() + buf_reserve_r()) and commits
+ */
+static inline int
+buf_reserve_r(struct buf_s *restrict buf, struct iovec *iov, size_t chunk)
 {
-	buf->did = (buf->did + chunk) & buf->mask;
+	int cnt = ibuf_iov(buf, iov, buf->res, chunk);
+
+	buf->res = (buf->res + chunk) & buf->mask;
+	return cnt;
+}
+
+/*
+ * parallel writers - the same scheme for the writer side: full blocks past
+ * did are reserved in order (wres marks the end), written in any order, and
+ * committed with buf_commit_w/wf() in the order of reservation, so did only
+ * ever moves forward over completed data
+ */
+static inline int
+buf_reserve_w(struct buf_s *restrict buf, struct iovec *iov, size_t chunk)
+{
+	int cnt = ibuf_iov(buf, iov, buf->wres, chunk);
+
+	buf->wres = (buf->wres + chunk) & buf->mask;
+	return cnt;
 }
 
 /* common interface follows */
@@ -145,19 +284,36 @@ int  buf_ctor(struct buf_s *buf, size_t bsiz, size_t rblk, size_t wblk, size_t h
 void buf_dtor(struct buf_s *buf);
 void buf_dt(struct buf_s *buf);
 
-int buf_setextra(struct buf_s *buf, int rline, int wline, int rcrc, int wcrc, double rs, double ws);
+int buf_setextra(struct buf_s *buf, int rline, int wline, int rcrc, int wcrc, int dgst, double rs, double ws);
+void buf_setcrct(struct buf_s *buf);
 void buf_report_init(struct buf_s *buf);
 void buf_report_stats(struct buf_s *buf);
 void buf_setlinew(struct buf_s *buf);
 
 size_t buf_can_r(struct buf_s *restrict buf);
-uint8_t *buf_fetch_r(struct buf_s *restrict buf, size_t chunk);
+size_t buf_can_rn(struct buf_s *restrict buf, size_t cnt);
+size_t buf_can_rs(struct buf_s *restrict buf);
+int buf_reserve_r(struct buf_s *restrict buf, struct iovec *iov, size_t chunk);
+int buf_fetch_r(const struct buf_s *restrict buf, struct iovec *iov, size_t chunk);
 void buf_commit_r(struct buf_s *restrict buf, size_t chunk);
 void buf_commit_rf(struct buf_s *restrict buf, size_t chunk);
 
+size_t buf_can_c(struct buf_s *restrict buf);
+size_t buf_can_cn(struct buf_s *restrict buf, size_t cnt);
+void buf_commit_c(struct buf_s *restrict buf, size_t chunk);
+void buf_commit_cf(struct buf_s *restrict buf, size_t chunk);
+void buf_crct_fin(struct buf_s *restrict buf);
+
 size_t buf_can_w(struct buf_s *restrict buf);
-uint8_t *buf_fetch_w(struct buf_s *restrict buf, size_t chunk);
+size_t buf_can_wn(struct buf_s *restrict buf, size_t cnt);
+size_t buf_can_ws(struct buf_s *restrict buf);
+size_t buf_can_wp(struct buf_s *restrict buf);
+int buf_reserve_w(struct buf_s *restrict buf, struct iovec *iov, size_t chunk);
+int buf_fetch_w(const struct buf_s *restrict buf, struct iovec *iov, size_t chunk);
+int buf_fetchpad_w(struct buf_s *restrict buf, struct iovec *iov, size_t chunk, size_t pad);
 void buf_commit_w(struct buf_s *restrict buf, size_t chunk);
 void buf_commit_wf(struct buf_s *restrict buf, size_t chunk);
+void buf_commit_wg(struct buf_s *restrict buf, size_t chunk);
+void buf_commit_wr(struct buf_s *restrict buf, size_t chunk);
 
 #endif
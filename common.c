@@ -25,6 +25,7 @@
 // #include <string.h>
 
 #include "crc.h"
+#include "digest.h"
 
 const char err_generic[] = "%s failure @%s:%d\n";
 
@@ -107,6 +108,30 @@ int is_pow2(size_t x)
 	return cnt == 1 ? posr : posr | INT_MIN;
 }
 
+/*
+ * all-zero check; the 64 byte stride is OR-ed together word by word, which
+ * the compiler turns into vector loads - so on non-zero data it bails out
+ * after the first stride, and on zero data it runs at memory speed
+ */
+int is_zero(const void *ptr, size_t len)
+{
+	typedef uint64_t __attribute__ ((__may_alias__)) word_t;
+	const uint8_t *p = ptr;
+	const word_t *w;
+
+	for (; len && ((uintptr_t)p & 7); len--)
+		if (*p++)
+			return 0;
+	for (w = (const word_t *)p; len >= 64; len -= 64, w += 8) {
+		if (w[0] | w[1] | w[2] | w[3] | w[4] | w[5] | w[6] | w[7])
+			return 0;
+	}
+	for (p = (const uint8_t *)w; len; len--)
+		if (*p++)
+			return 0;
+	return 1;
+}
+
 void get_strrnd(char *restrict s, int len) {
 	static const char a[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz1234567890";
 
@@ -149,6 +174,7 @@ size_t get_pathmax(const char *ptr __attribute__ ((__unused__)))
 int common_init(void)
 {
 	crc_init();
+	dg_init();
 	srand ((unsigned int)time(0));
 	return 0;
 }
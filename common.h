@@ -22,6 +22,14 @@
 #include "config.h"
 #include <stdint.h>
 #include <unistd.h>
+#ifndef h_mingw
+# include <sys/uio.h>
+#else
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+#endif
 
 /*
  * in order: cpu+comp barrier, comp barrier, variable barrier
@@ -33,6 +41,26 @@
 
 #define cmpxchg(x,o,n) __sync_bool_compare_and_swap(&(x),(o),(n));
 
+/*
+ * acquire / release accessors (C11 memory model, through gcc's __atomic
+ * builtins, as we stay at gnu99); used for single producer / single consumer
+ * handoff of buffer cursors
+ */
+#define load_acq(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define load_rlx(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define store_rel(x,v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define store_rlx(x,v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+#if defined(__i386__) || defined(__x86_64__)
+# define cpu_relax() __builtin_ia32_pause()
+#else
+# define cpu_relax() barrier()
+#endif
+
+/* assumed cache line size, for separating data owned by different tasks */
+#define Y_CLINE 64
+#define cline_aligned __attribute__ ((__aligned__ (Y_CLINE)))
+
 #define Y_MAX(x,y) ((x) > (y) ? (x) : (y))
 #define Y_MIN(x,y) ((x) < (y) ? (x) : (y))
 #define Y_ALIGN(x, a) (((uintptr_t)(x) + a - 1) & ~((uintptr_t)(a) - 1))
@@ -72,6 +100,7 @@
 unsigned long int get_ul(const char *s);
 double get_double(const char *s);
 int is_pow2(size_t x);
+int is_zero(const void *ptr, size_t len);
 void get_strrnd(char *restrict s, int len);
 size_t get_page(void);
 size_t get_pathmax(const char *ptr);
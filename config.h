@@ -32,17 +32,32 @@
 #  define has_shm_malloc 1
 #  define has_mtx_sem 1
 #  define has_mtx_posix 1
+#  define has_ftx_linux 1
+#  define has_uring_linux 1
 #endif
 
 #  define has_mtx_posix 1
 #  define has_sem_posixu 1
 #  define has_shm_posix 1
+#  define has_ftx_linux 1
+#  define has_mmsg 1
+#  define has_splice 1
+#  define has_offload 1
+#  define has_uring_linux 1
+#  define has_dio 1
+#  define has_fcache 1
+#  define has_falloc 1
+#  define has_sparse 1
+#  define has_fmap 1
+#  define has_fseg 1
 
 # elif defined(h_freebsd)
 
 #  define has_mtx_posix 1
 #  define has_sem_posixu 1
 #  define has_shm_posix 1
+#  define has_fmap 1
+#  define has_fseg 1
 //#  define _BSD_SOURCE 1
 
 # elif defined(h_bsd)
@@ -60,6 +75,11 @@
 
 # endif
 
+/* carry-less multiply crc kernels and simd digest kernels, picked at runtime (cpuid) */
+# if defined(__x86_64__) && defined(__GNUC__) && !defined(h_mingw)
+#  define has_clmul 1
+# endif
+
 #if 0
 # if defined(has_sem_sysv) || defined (has_shm_sysv)
 #  define _SVID_SOURCE 1
@@ -20,6 +20,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "crc.h"
+#if defined(has_clmul) && CRC_SLICE
+# include <immintrin.h>
+#endif
 
 #define CRCMASK (((((CRCINT)1<<(CRCBITS-1))-1)<<1)|1)
 
@@ -27,6 +30,17 @@
 #define CRC_XOROUT (~((CRCINT)0))
 
 CRCINT ctab[256];
+#if CRC_SLICE
+/* ctabs[k][b] - crc of byte b followed by k zero bytes */
+CRCINT ctabs[CRC_SLICE][256];
+CRCINT (*crc_bulk)(CRCINT, const uint8_t * restrict, size_t) = crc_calc_s;
+#endif
+static const char *crc_kern = "table";
+#if defined(has_clmul) && CRC_SLICE
+static void clmul_init(void);
+static CRCINT crc_calc_c(CRCINT, const uint8_t * restrict, size_t);
+static CRCINT crc_calc_z(CRCINT, const uint8_t * restrict, size_t);
+#endif
 /* CRC-32 std */
 static const CRCINT poly = 0x04C11DB7;
 #if 0
@@ -73,7 +87,199 @@ void crc_init(void)
 #endif
 		ctab[i] = c;
 	}
+#if CRC_SLICE
+	for (i = 0; i < 256; i++) {
+		c = ctabs[0][i] = ctab[i];
+		for (j = 1; j < CRC_SLICE; j++)
+			c = ctabs[j][i] = (c << 8) ^ ctab[c >> (CRCBITS - 8)];
+	}
+#endif
+#if defined(has_clmul) && CRC_SLICE
+	clmul_init();
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+	    __builtin_cpu_supports("vpclmulqdq")) {
+		crc_bulk = crc_calc_z;
+		crc_kern = "vpclmulqdq";
+	} else if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3")) {
+		crc_bulk = crc_calc_c;
+		crc_kern = "pclmulqdq";
+	} else
+#endif
+#if CRC_SLICE
+		crc_kern = "slicing-by-16";
+#endif
+}
+
+const char *crc_impl(void)
+{
+	return crc_kern;
+}
+
+#if CRC_SLICE
+/*
+ * CRC_SLICE bytes per iteration - the first 4 are folded with the crc, the
+ * rest contribute on their own; each byte's table accounts for the number of
+ * bytes following it in the slice
+ */
+CRCINT crc_calc_s(CRCINT c, const uint8_t * restrict d, size_t cnt)
+{
+	CRCINT x;
+	int i;
+
+	for (; cnt >= CRC_SLICE; cnt -= CRC_SLICE, d += CRC_SLICE) {
+		x = c ^ ((CRCINT)d[0] << 24 | (CRCINT)d[1] << 16 | (CRCINT)d[2] << 8 | d[3]);
+		c = ctabs[CRC_SLICE - 1][x >> 24] ^
+		    ctabs[CRC_SLICE - 2][x >> 16 & 0xFF] ^
+		    ctabs[CRC_SLICE - 3][x >> 8 & 0xFF] ^
+		    ctabs[CRC_SLICE - 4][x & 0xFF];
+		for (i = 4; i < CRC_SLICE; i++)
+			c ^= ctabs[CRC_SLICE - 1 - i][d[i]];
+	}
+	return crc_calc_1(c, d, cnt);
 }
+#endif
+
+#if defined(has_clmul) && CRC_SLICE
+/*
+ * folding with carry-less multiplication (non-reflected crc, see intel's
+ * "fast crc computation for generic polynomials using pclmulqdq")
+ *
+ * 16 byte blocks are loaded byte-swapped, so bit n of a register is the
+ * coefficient of x^n; a block is moved d bits forward as hi * (x^(d+64) mod
+ * P) + lo * (x^d mod P), which fits in 96 bits and is xored with the block
+ * found there; the last 128 bits are reduced to the crc (x^32 * x mod P)
+ * through 96 and 64 bits, and barrett reduction
+ *
+ * ck[n] - fold constants for d = 128 * n (lo: x^d, hi: x^(d+64)); ckr - x^96,
+ * x^64, floor(x^64 / P), P
+ */
+static uint64_t ck[17][2];
+static uint64_t ckr[4];
+
+#define CK(d) _mm_loadu_si128((const __m128i *)ck[(d) / 128])
+#define FOLD(x, k) _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00))
+#define FOLDZ(x, k) _mm512_xor_si512(_mm512_clmulepi64_epi128(x, k, 0x11), _mm512_clmulepi64_epi128(x, k, 0x00))
+#define SWAP _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+#define LD(p) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p)), SWAP)
+#define LDZ(p) _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(p)), sw)
+
+static uint64_t xpow(unsigned int n)
+{
+	uint64_t r = 1;
+
+	while (n--) {
+		r <<= 1;
+		if (r >> CRCBITS)
+			r ^= (uint64_t)1 << CRCBITS | poly;
+	}
+	return r;
+}
+
+static void clmul_init(void)
+{
+	uint64_t q = 0, r = 0;
+	int i;
+
+	for (i = 0; i < 17; i++) {
+		ck[i][0] = xpow(128 * (unsigned)i);
+		ck[i][1] = xpow(128 * (unsigned)i + 64);
+	}
+	/* long division of x^64 */
+	for (i = 64; i >= 0; i--) {
+		r = r << 1 | (i == 64);
+		q <<= 1;
+		if (r >> CRCBITS) {
+			r ^= (uint64_t)1 << CRCBITS | poly;
+			q |= 1;
+		}
+	}
+	ckr[0] = xpow(96);
+	ckr[1] = xpow(64);
+	ckr[2] = q;
+	ckr[3] = (uint64_t)1 << CRCBITS | poly;
+}
+
+/* folds the remaining full blocks into x, reduces it, the tail goes to tables */
+__attribute__ ((__target__ ("pclmul,ssse3")))
+static CRCINT crc_fold(__m128i x, const uint8_t * restrict d, size_t cnt)
+{
+	const __m128i k = CK(128);
+	uint64_t u, q;
+
+	for (; cnt >= 16; cnt -= 16, d += 16)
+		x = _mm_xor_si128(FOLD(x, k), LD(d));
+	x = _mm_xor_si128(_mm_clmulepi64_si128(x, _mm_cvtsi64_si128((long long)ckr[0]), 0x01), _mm_slli_si128(_mm_move_epi64(x), 4));
+	x = _mm_xor_si128(_mm_clmulepi64_si128(x, _mm_cvtsi64_si128((long long)ckr[1]), 0x01), _mm_move_epi64(x));
+	u = (uint64_t)_mm_cvtsi128_si64(x);
+	q = (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)(u >> 32)), _mm_cvtsi64_si128((long long)ckr[2]), 0x00)) >> 32;
+	u ^= (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)q), _mm_cvtsi64_si128((long long)ckr[3]), 0x00));
+	return crc_calc_1((CRCINT)u, d, cnt);
+}
+
+/* 4 x 128 bit lanes */
+__attribute__ ((__target__ ("pclmul,ssse3")))
+static CRCINT crc_calc_c(CRCINT c, const uint8_t * restrict d, size_t cnt)
+{
+	__m128i x0, x1, x2, x3, k;
+
+	if (cnt < 64)
+		return crc_calc_s(c, d, cnt);
+	x0 = _mm_xor_si128(LD(d), _mm_set_epi32((int)c, 0, 0, 0));
+	x1 = LD(d + 16);
+	x2 = LD(d + 32);
+	x3 = LD(d + 48);
+	k = CK(512);
+	for (d += 64, cnt -= 64; cnt >= 64; cnt -= 64, d += 64) {
+		x0 = _mm_xor_si128(FOLD(x0, k), LD(d));
+		x1 = _mm_xor_si128(FOLD(x1, k), LD(d + 16));
+		x2 = _mm_xor_si128(FOLD(x2, k), LD(d + 32));
+		x3 = _mm_xor_si128(FOLD(x3, k), LD(d + 48));
+	}
+	x3 = _mm_xor_si128(x3, FOLD(x0, CK(384)));
+	x3 = _mm_xor_si128(x3, FOLD(x1, CK(256)));
+	x3 = _mm_xor_si128(x3, FOLD(x2, CK(128)));
+	return crc_fold(x3, d, cnt);
+}
+
+/* 4 x 512 bit registers, 4 lanes each */
+__attribute__ ((__target__ ("avx512f,avx512bw,vpclmulqdq,pclmul,ssse3")))
+static CRCINT crc_calc_z(CRCINT c, const uint8_t * restrict d, size_t cnt)
+{
+	const __m512i sw = _mm512_broadcast_i32x4(SWAP);
+	__m512i z0, z1, z2, z3, k;
+	__m128i x;
+
+	if (cnt < 256)
+		return crc_calc_c(c, d, cnt);
+	z0 = _mm512_xor_si512(LDZ(d), _mm512_zextsi128_si512(_mm_set_epi32((int)c, 0, 0, 0)));
+	z1 = LDZ(d + 64);
+	z2 = LDZ(d + 128);
+	z3 = LDZ(d + 192);
+	k = _mm512_broadcast_i32x4(CK(2048));
+	for (d += 256, cnt -= 256; cnt >= 256; cnt -= 256, d += 256) {
+		z0 = _mm512_xor_si512(FOLDZ(z0, k), LDZ(d));
+		z1 = _mm512_xor_si512(FOLDZ(z1, k), LDZ(d + 64));
+		z2 = _mm512_xor_si512(FOLDZ(z2, k), LDZ(d + 128));
+		z3 = _mm512_xor_si512(FOLDZ(z3, k), LDZ(d + 192));
+	}
+	z3 = _mm512_xor_si512(z3, FOLDZ(z0, _mm512_broadcast_i32x4(CK(1536))));
+	z3 = _mm512_xor_si512(z3, FOLDZ(z1, _mm512_broadcast_i32x4(CK(1024))));
+	z3 = _mm512_xor_si512(z3, FOLDZ(z2, _mm512_broadcast_i32x4(CK(512))));
+	for (k = _mm512_broadcast_i32x4(CK(512)); cnt >= 64; cnt -= 64, d += 64)
+		z3 = _mm512_xor_si512(FOLDZ(z3, k), LDZ(d));
+	/* lanes 0 - 2 onto lane 3 */
+	k = _mm512_set_epi64(0, 0,
+			(long long)ck[1][1], (long long)ck[1][0],
+			(long long)ck[2][1], (long long)ck[2][0],
+			(long long)ck[3][1], (long long)ck[3][0]);
+	z0 = FOLDZ(z3, k);
+	x = _mm_xor_si128(_mm512_extracti32x4_epi32(z3, 3), _mm512_extracti32x4_epi32(z0, 0));
+	x = _mm_xor_si128(x, _mm512_extracti32x4_epi32(z0, 1));
+	x = _mm_xor_si128(x, _mm512_extracti32x4_epi32(z0, 2));
+	return crc_fold(x, d, cnt);
+}
+#endif
 
 CRCINT crc_cksum(CRCINT c, uint64_t b)
 {
@@ -101,6 +307,57 @@ CRCINT crc_end(CRCINT c)
 	return (c ^ CRC_XOROUT) & CRCMASK;
 }
 
+/*
+ * crc combination - the state is linear in both the initial state and the
+ * data, so the state after A || B is the state after A shifted by len(B)
+ * zero bytes, xored with the state taken over B alone (from 0)
+ *
+ * the shift is a CRCBITS x CRCBITS matrix over GF(2) (op[i] is the image of
+ * bit i); the one for a single zero byte comes from the table, and the one
+ * for len bytes is built by repeated squaring
+ */
+static void gf2_mul(CRCINT *r, const CRCINT *a, const CRCINT *b)
+{
+	int i;
+
+	for (i = 0; i < CRCBITS; i++)
+		r[i] = crc_shift(a, b[i]);
+}
+
+void crc_shift_op(CRCINT *op, uint64_t len)
+{
+	CRCINT sq[CRCBITS], t[CRCBITS], c;
+	int i;
+
+	for (i = 0; i < CRCBITS; i++) {
+		c = (CRCINT)1 << i;
+#if CRC_REFIN == 1
+		sq[i] = (c >> 8) ^ ctab[c & 0xFF];
+#else
+		sq[i] = ((c << 8) ^ ctab[c >> (CRCBITS - 8) & 0xFF]) & CRCMASK;
+#endif
+		op[i] = c;
+	}
+	while (len) {
+		if (len & 1) {
+			gf2_mul(t, sq, op);
+			memcpy(op, t, sizeof t);
+		}
+		if (len >>= 1) {
+			gf2_mul(t, sq, sq);
+			memcpy(sq, t, sizeof t);
+		}
+	}
+}
+
+CRCINT crc_combine(CRCINT c1, CRCINT c2, uint64_t len2)
+{
+	CRCINT op[CRCBITS];
+
+	crc_shift_op(op, len2);
+	return crc_shift(op, c1) ^ c2;
+}
+
 CRCINT crc_str(const char * restrict ptr)
 {
 	size_t len = strlen(ptr);
@@ -35,16 +35,46 @@
 # error "> 64 bit ints not supported ..."
 #endif
 
+/*
+ * slicing-by-N (8 or 16) tables, for the non-reflected 32 bit variant; 0
+ * leaves the plain byte-at-a-time table only
+ */
+#if CRCBITS == 32 && CRC_REFIN == 0
+# define CRC_SLICE 16
+#else
+# define CRC_SLICE 0
+#endif
+
 extern CRCINT ctab[256];
+#if CRC_SLICE
+extern CRCINT ctabs[CRC_SLICE][256];
+#endif
 
 void crc_init(void);
 CRCINT crc_beg(void);
 CRCINT crc_cksum(CRCINT, uint64_t);
 CRCINT crc_end(CRCINT);
 CRCINT crc_str(const char * restrict);
+void crc_shift_op(CRCINT *op, uint64_t len);
+CRCINT crc_combine(CRCINT, CRCINT, uint64_t);
 
+/*
+ * applies a shift operator (see crc_shift_op()) - the crc state after len
+ * more zero bytes
+ */
 static inline CRCINT
-crc_calc(CRCINT c, const uint8_t * restrict d, size_t cnt)
+crc_shift(const CRCINT *op, CRCINT c)
+{
+	CRCINT r = 0;
+
+	for (; c; c >>= 1, op++)
+		if (c & 1)
+			r ^= *op;
+	return r;
+}
+
+static inline CRCINT
+crc_calc_1(CRCINT c, const uint8_t * restrict d, size_t cnt)
 {
 #if CRC_REFIN == 1
 	while likely(cnt--)
@@ -56,4 +86,21 @@ crc_calc(CRCINT c, const uint8_t * restrict d, size_t cnt)
 	return c;
 }
 
+#if CRC_SLICE
+CRCINT crc_calc_s(CRCINT, const uint8_t * restrict, size_t);
+/* bulk kernel - slicing, or a carry-less multiply one chosen by crc_init() */
+extern CRCINT (*crc_bulk)(CRCINT, const uint8_t * restrict, size_t);
+#endif
+const char *crc_impl(void);
+
+static inline CRCINT
+crc_calc(CRCINT c, const uint8_t * restrict d, size_t cnt)
+{
+#if CRC_SLICE
+	if likely(cnt >= CRC_SLICE)
+		return crc_bulk(c, d, cnt);
+#endif
+	return crc_calc_1(c, d, cnt);
+}
+
 #endif
@@ -0,0 +1,608 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include "digest.h"
+#if defined(has_clmul)
+# include <immintrin.h>
+#endif
+
+static const char *dg_names[] = { "crc32", "crc32c", "xxh64", "blake3" };
+
+static inline uint32_t ld32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t ld64(const uint8_t *p)
+{
+	return (uint64_t)ld32(p) | (uint64_t)ld32(p + 4) << 32;
+}
+
+static inline void st32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+/*
+ * crc32c (castagnoli, reflected) - slicing-by-8, or the sse4.2 crc32
+ * instruction over 3 interleaved lanes of C32_LANE bytes; the lanes are
+ * merged by shifting the preceding crc over the next lane's length (c32sh -
+ * bytewise tables of that linear operator)
+ */
+#define C32_POLY 0x82F63B78
+#define C32_LANE 1024
+
+static uint32_t c32tab[8][256];
+static uint32_t c32sh[4][256];
+static uint32_t c32_calc_s(uint32_t, const uint8_t *restrict, size_t);
+static uint32_t (*c32_bulk)(uint32_t, const uint8_t *restrict, size_t) = c32_calc_s;
+static const char *c32_kern = "slicing-by-8";
+
+static inline uint32_t c32_shift(uint32_t c)
+{
+	return c32sh[0][c & 0xFF] ^ c32sh[1][c >> 8 & 0xFF] ^
+	       c32sh[2][c >> 16 & 0xFF] ^ c32sh[3][c >> 24];
+}
+
+static inline uint32_t c32_calc_1(uint32_t c, const uint8_t *restrict d, size_t cnt)
+{
+	while (cnt--)
+		c = (c >> 8) ^ c32tab[0][(c ^ *d++) & 0xFF];
+	return c;
+}
+
+static uint32_t c32_calc_s(uint32_t c, const uint8_t *restrict d, size_t cnt)
+{
+	uint32_t h;
+
+	for (; cnt >= 8; cnt -= 8, d += 8) {
+		c ^= ld32(d);
+		h = ld32(d + 4);
+		c = c32tab[7][c & 0xFF] ^ c32tab[6][c >> 8 & 0xFF] ^
+		    c32tab[5][c >> 16 & 0xFF] ^ c32tab[4][c >> 24] ^
+		    c32tab[3][h & 0xFF] ^ c32tab[2][h >> 8 & 0xFF] ^
+		    c32tab[1][h >> 16 & 0xFF] ^ c32tab[0][h >> 24];
+	}
+	return c32_calc_1(c, d, cnt);
+}
+
+#if defined(has_clmul)
+__attribute__ ((__target__ ("sse4.2")))
+static uint32_t c32_calc_h(uint32_t c, const uint8_t *restrict d, size_t cnt)
+{
+	uint64_t a, b, e;
+	size_t i;
+
+	for (; cnt && (uintptr_t)d & 7; cnt--)
+		c = _mm_crc32_u8(c, *d++);
+	for (; cnt >= 3 * C32_LANE; cnt -= 3 * C32_LANE, d += 3 * C32_LANE) {
+		a = c;
+		b = e = 0;
+		for (i = 0; i < C32_LANE; i += 8) {
+			a = _mm_crc32_u64(a, ld64(d + i));
+			b = _mm_crc32_u64(b, ld64(d + C32_LANE + i));
+			e = _mm_crc32_u64(e, ld64(d + 2 * C32_LANE + i));
+		}
+		c = c32_shift(c32_shift((uint32_t)a) ^ (uint32_t)b) ^ (uint32_t)e;
+	}
+	for (a = c; cnt >= 8; cnt -= 8, d += 8)
+		a = _mm_crc32_u64(a, ld64(d));
+	for (c = (uint32_t)a; cnt; cnt--)
+		c = _mm_crc32_u8(c, *d++);
+	return c;
+}
+#endif
+
+static void c32_init(void)
+{
+	uint32_t op[32], c;
+	int i, j, k;
+
+	for (i = 0; i < 256; i++) {
+		c = (uint32_t)i;
+		for (j = 0; j < 8; j++)
+			c = c & 1 ? (c >> 1) ^ C32_POLY : c >> 1;
+		c32tab[0][i] = c;
+	}
+	for (i = 0; i < 256; i++)
+		for (c = c32tab[0][i], j = 1; j < 8; j++)
+			c = c32tab[j][i] = (c >> 8) ^ c32tab[0][c & 0xFF];
+	/* images of the single bits over C32_LANE zero bytes */
+	for (i = 0; i < 32; i++) {
+		c = (uint32_t)1 << i;
+		for (j = 0; j < C32_LANE; j++)
+			c = (c >> 8) ^ c32tab[0][c & 0xFF];
+		op[i] = c;
+	}
+	for (k = 0; k < 4; k++)
+		for (i = 0; i < 256; i++) {
+			for (c = 0, j = 0; j < 8; j++)
+				if (i >> j & 1)
+					c ^= op[8 * k + j];
+			c32sh[k][i] = c;
+		}
+#if defined(has_clmul)
+	if (__builtin_cpu_supports("sse4.2")) {
+		c32_bulk = c32_calc_h;
+		c32_kern = "sse4.2 (3 lanes)";
+	}
+#endif
+}
+
+/*
+ * xxh64 (seed 0) - 32 byte stripes over 4 accumulators, the remainder is kept
+ * in mem until the next call or the end
+ */
+#define XP1 0x9E3779B185EBCA87ULL
+#define XP2 0xC2B2AE3D27D4EB4FULL
+#define XP3 0x165667B19E3779F9ULL
+#define XP4 0x85EBCA77C2B2AE63ULL
+#define XP5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return x << r | x >> (64 - r);
+}
+
+static inline uint64_t xx_round(uint64_t acc, uint64_t in)
+{
+	return rotl64(acc + in * XP2, 31) * XP1;
+}
+
+static inline uint64_t xx_merge(uint64_t h, uint64_t v)
+{
+	return (h ^ xx_round(0, v)) * XP1 + XP4;
+}
+
+static inline void xx_stripe(uint64_t *restrict v, const uint8_t *restrict d)
+{
+	v[0] = xx_round(v[0], ld64(d));
+	v[1] = xx_round(v[1], ld64(d + 8));
+	v[2] = xx_round(v[2], ld64(d + 16));
+	v[3] = xx_round(v[3], ld64(d + 24));
+}
+
+static void xx_beg(struct xxh64_s *x)
+{
+	x->v[0] = XP1 + XP2;
+	x->v[1] = XP2;
+	x->v[2] = 0;
+	x->v[3] = -XP1;
+	x->len = 0;
+	x->fill = 0;
+}
+
+static void xx_calc(struct xxh64_s *restrict x, const uint8_t *restrict d, size_t cnt)
+{
+	uint64_t v[4];
+	size_t k;
+
+	x->len += cnt;
+	if (x->fill) {
+		k = Y_MIN(32 - x->fill, cnt);
+		memcpy(x->mem + x->fill, d, k);
+		x->fill += (unsigned int)k;
+		d += k;
+		cnt -= k;
+		if (x->fill < 32)
+			return;
+		xx_stripe(x->v, x->mem);
+		x->fill = 0;
+	}
+	memcpy(v, x->v, sizeof v);
+	for (; cnt >= 32; cnt -= 32, d += 32)
+		xx_stripe(v, d);
+	memcpy(x->v, v, sizeof v);
+	memcpy(x->mem, d, cnt);
+	x->fill = (unsigned int)cnt;
+}
+
+static uint64_t xx_end(const struct xxh64_s *x)
+{
+	const uint8_t *d = x->mem;
+	unsigned int cnt = x->fill;
+	uint64_t h;
+
+	if (x->len >= 32) {
+		h = rotl64(x->v[0], 1) + rotl64(x->v[1], 7) + rotl64(x->v[2], 12) + rotl64(x->v[3], 18);
+		h = xx_merge(h, x->v[0]);
+		h = xx_merge(h, x->v[1]);
+		h = xx_merge(h, x->v[2]);
+		h = xx_merge(h, x->v[3]);
+	} else
+		h = x->v[2] + XP5;
+	h += x->len;
+	for (; cnt >= 8; cnt -= 8, d += 8)
+		h = rotl64(h ^ xx_round(0, ld64(d)), 27) * XP1 + XP4;
+	if (cnt >= 4) {
+		h = rotl64(h ^ (uint64_t)ld32(d) * XP1, 23) * XP2 + XP3;
+		cnt -= 4;
+		d += 4;
+	}
+	for (; cnt; cnt--)
+		h = rotl64(h ^ *d++ * XP5, 11) * XP1;
+	h ^= h >> 33;
+	h *= XP2;
+	h ^= h >> 29;
+	h *= XP3;
+	h ^= h >> 32;
+	return h;
+}
+
+/*
+ * blake3 (hash mode, 32 byte output) - the chunks are compressed B3_WAY at a
+ * time with gcc's generic vectors (one chunk per lane), and fed to the tree
+ * in order; the last chunk always stays in the hasher, as it might be the
+ * root
+ */
+#define B3_START  0x01
+#define B3_END    0x02
+#define B3_PARENT 0x04
+#define B3_ROOT   0x08
+#define B3_CHUNK  1024
+#define B3_WAY    8
+
+typedef uint32_t v8u __attribute__ ((__vector_size__ (4 * B3_WAY)));
+
+static const uint32_t b3iv[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+	0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+/* message word order of each round (successive applications of the permutation) */
+static const uint8_t b3sched[7][16] = {
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+	{  2,  6,  3, 10,  7,  0,  4, 13,  1, 11, 12,  5,  9, 14, 15,  8 },
+	{  3,  4, 10, 12, 13,  2,  7, 14,  6,  5,  9,  0, 11, 15,  8,  1 },
+	{ 10,  7, 12,  9, 14,  3, 13, 15,  4,  0, 11,  2,  5,  8,  1,  6 },
+	{ 12, 13,  9, 11, 15, 10, 14,  8,  7,  2,  5,  3,  0,  1,  6,  4 },
+	{  9, 14, 11,  5,  8, 12, 15,  1, 13,  3,  0, 10,  2,  6,  4,  7 },
+	{ 11, 15,  5,  0,  1,  9,  8,  6, 14, 10,  2, 12,  3,  4,  7, 13 },
+};
+
+/* used for both scalars and vectors */
+#define B3ROR(x, n) ((x) >> (n) | (x) << (32 - (n)))
+#define B3G(a, b, c, d, x, y) do { \
+	a += b + x; d = B3ROR(d ^ a, 16); c += d; b = B3ROR(b ^ c, 12); \
+	a += b + y; d = B3ROR(d ^ a, 8);  c += d; b = B3ROR(b ^ c, 7); \
+} while (0)
+#define B3R(v, m, s) do { \
+	B3G(v[0], v[4], v[8],  v[12], m[s[0]],  m[s[1]]); \
+	B3G(v[1], v[5], v[9],  v[13], m[s[2]],  m[s[3]]); \
+	B3G(v[2], v[6], v[10], v[14], m[s[4]],  m[s[5]]); \
+	B3G(v[3], v[7], v[11], v[15], m[s[6]],  m[s[7]]); \
+	B3G(v[0], v[5], v[10], v[15], m[s[8]],  m[s[9]]); \
+	B3G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]); \
+	B3G(v[2], v[7], v[8],  v[13], m[s[12]], m[s[13]]); \
+	B3G(v[3], v[4], v[9],  v[14], m[s[14]], m[s[15]]); \
+} while (0)
+
+static void b3_many_g(uint32_t (*)[8], const uint8_t *restrict, uint64_t);
+static void (*b3_many)(uint32_t (*)[8], const uint8_t *restrict, uint64_t) = b3_many_g;
+static const char *b3_kern = "8-way generic";
+
+/* updates cv in place (the chaining value, or the root output) */
+static void b3_comp(uint32_t *restrict cv, const uint8_t *restrict blk, uint64_t t, uint32_t len, uint32_t flags)
+{
+	uint32_t m[16], v[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		m[i] = ld32(blk + 4 * i);
+	for (i = 0; i < 8; i++)
+		v[i] = cv[i];
+	for (i = 0; i < 4; i++)
+		v[8 + i] = b3iv[i];
+	v[12] = (uint32_t)t;
+	v[13] = (uint32_t)(t >> 32);
+	v[14] = len;
+	v[15] = flags;
+	for (i = 0; i < 7; i++)
+		B3R(v, m, b3sched[i]);
+	for (i = 0; i < 8; i++)
+		cv[i] = v[i] ^ v[i + 8];
+}
+
+/* 8x8 transpose of 32 bit words - blocks of 4, 2 and 1 words swapped in turn */
+static inline __attribute__ ((__always_inline__)) void
+b3_tr8(v8u *r)
+{
+	static const v8u lo4 = { 0, 1, 2, 3,  8,  9, 10, 11 }, hi4 = { 4, 5, 6, 7, 12, 13, 14, 15 };
+	static const v8u lo2 = { 0, 1, 8, 9,  4,  5, 12, 13 }, hi2 = { 2, 3, 10, 11, 6, 7, 14, 15 };
+	static const v8u lo1 = { 0, 8, 2, 10, 4, 12,  6, 14 }, hi1 = { 1, 9, 3, 11, 5, 13, 7, 15 };
+	v8u a;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		a = r[i];
+		r[i] = __builtin_shuffle(a, r[i + 4], lo4);
+		r[i + 4] = __builtin_shuffle(a, r[i + 4], hi4);
+	}
+	for (i = 0; i < 8; i += i & 1 ? 3 : 1) {
+		a = r[i];
+		r[i] = __builtin_shuffle(a, r[i + 2], lo2);
+		r[i + 2] = __builtin_shuffle(a, r[i + 2], hi2);
+	}
+	for (i = 0; i < 8; i += 2) {
+		a = r[i];
+		r[i] = __builtin_shuffle(a, r[i + 1], lo1);
+		r[i + 1] = __builtin_shuffle(a, r[i + 1], hi1);
+	}
+}
+
+/* B3_WAY full chunks starting with chunk t, their chaining values to out */
+static inline __attribute__ ((__always_inline__)) void
+b3_many_(uint32_t (*out)[8], const uint8_t *restrict d, uint64_t t)
+{
+	uint32_t w[16][B3_WAY];
+	v8u v[16], m[16], cv[8], lo, hi;
+	int b, i, l;
+
+	for (l = 0; l < B3_WAY; l++) {
+		w[0][l] = (uint32_t)(t + (uint64_t)l);
+		w[1][l] = (uint32_t)((t + (uint64_t)l) >> 32);
+	}
+	memcpy(&lo, w[0], sizeof lo);
+	memcpy(&hi, w[1], sizeof hi);
+	for (i = 0; i < 8; i++)
+		cv[i] = (v8u){} + b3iv[i];
+	for (b = 0; b < B3_CHUNK / 64; b++, d += 64) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		for (l = 0; l < B3_WAY; l++) {
+			memcpy(m + l, d + l * B3_CHUNK, sizeof *m);
+			memcpy(m + 8 + l, d + l * B3_CHUNK + 32, sizeof *m);
+		}
+		b3_tr8(m);
+		b3_tr8(m + 8);
+#else
+		for (i = 0; i < 16; i++)
+			for (l = 0; l < B3_WAY; l++)
+				w[i][l] = ld32(d + l * B3_CHUNK + 4 * i);
+		for (i = 0; i < 16; i++)
+			memcpy(m + i, w[i], sizeof *m);
+#endif
+		for (i = 0; i < 8; i++)
+			v[i] = cv[i];
+		for (i = 0; i < 4; i++)
+			v[8 + i] = (v8u){} + b3iv[i];
+		v[12] = lo;
+		v[13] = hi;
+		v[14] = (v8u){} + 64;
+		v[15] = (v8u){} + (uint32_t)((b ? 0 : B3_START) | (b < B3_CHUNK / 64 - 1 ? 0 : B3_END));
+#pragma GCC unroll 7
+		for (i = 0; i < 7; i++)
+			B3R(v, m, b3sched[i]);
+		for (i = 0; i < 8; i++)
+			cv[i] = v[i] ^ v[i + 8];
+	}
+	b3_tr8(cv);
+	for (l = 0; l < B3_WAY; l++)
+		memcpy(out[l], cv + l, sizeof *cv);
+}
+
+static void b3_many_g(uint32_t (*out)[8], const uint8_t *restrict d, uint64_t t)
+{
+	b3_many_(out, d, t);
+}
+
+#if defined(has_clmul)
+__attribute__ ((__target__ ("avx2")))
+static void b3_many_a(uint32_t (*out)[8], const uint8_t *restrict d, uint64_t t)
+{
+	b3_many_(out, d, t);
+}
+#endif
+
+static void b3_reset(struct b3_s *h, uint64_t chunk)
+{
+	memcpy(h->cv, b3iv, sizeof h->cv);
+	memset(h->blk, 0, sizeof h->blk);
+	h->chunk = chunk;
+	h->blen = h->bcnt = 0;
+}
+
+static void b3_beg(struct b3_s *h)
+{
+	b3_reset(h, 0);
+	h->depth = 0;
+}
+
+static void b3_parent(uint32_t *out, const uint32_t *l, const uint32_t *r, uint32_t flags)
+{
+	uint8_t blk[64];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		st32(blk + 4 * i, l[i]);
+		st32(blk + 32 + 4 * i, r[i]);
+	}
+	memcpy(out, b3iv, sizeof b3iv);
+	b3_comp(out, blk, 0, 64, B3_PARENT | flags);
+}
+
+static void b3_chunk_cv(const struct b3_s *h, uint32_t *cv, uint32_t flags)
+{
+	memcpy(cv, h->cv, sizeof h->cv);
+	b3_comp(cv, h->blk, h->chunk, h->blen, (h->bcnt ? 0 : B3_START) | B3_END | flags);
+}
+
+/* merges the completed subtrees, as long as total (chunks so far) allows */
+static void b3_push(struct b3_s *h, uint32_t *cv, uint64_t total)
+{
+	for (; !(total & 1); total >>= 1)
+		b3_parent(cv, h->stack[--h->depth], cv, 0);
+	memcpy(h->stack[h->depth++], cv, sizeof h->stack[0]);
+}
+
+static void b3_calc(struct b3_s *restrict h, const uint8_t *restrict d, size_t cnt)
+{
+	uint32_t cv[B3_WAY][8];
+	size_t k;
+	int i;
+
+	while (cnt) {
+		if (h->bcnt * 64 + h->blen == B3_CHUNK) {
+			b3_chunk_cv(h, cv[0], 0);
+			b3_push(h, cv[0], h->chunk + 1);
+			b3_reset(h, h->chunk + 1);
+		}
+		if (!h->bcnt && !h->blen && cnt > B3_WAY * B3_CHUNK) {
+			b3_many(cv, d, h->chunk);
+			for (i = 0; i < B3_WAY; i++)
+				b3_push(h, cv[i], h->chunk + (uint64_t)i + 1);
+			h->chunk += B3_WAY;
+			d += B3_WAY * B3_CHUNK;
+			cnt -= B3_WAY * B3_CHUNK;
+			continue;
+		}
+		if (h->blen == 64) {
+			b3_comp(h->cv, h->blk, h->chunk, 64, h->bcnt ? 0 : B3_START);
+			memset(h->blk, 0, sizeof h->blk);
+			h->blen = 0;
+			h->bcnt++;
+		}
+		k = Y_MIN(64 - h->blen, cnt);
+		memcpy(h->blk + h->blen, d, k);
+		h->blen += (unsigned int)k;
+		d += k;
+		cnt -= k;
+	}
+}
+
+static void b3_end(const struct b3_s *h, uint8_t *out)
+{
+	uint32_t cv[8];
+	int i = (int)h->depth;
+
+	if (!i)
+		b3_chunk_cv(h, cv, B3_ROOT);
+	else {
+		b3_chunk_cv(h, cv, 0);
+		while (--i > 0)
+			b3_parent(cv, h->stack[i], cv, 0);
+		b3_parent(cv, h->stack[0], cv, B3_ROOT);
+	}
+	for (i = 0; i < 8; i++)
+		st32(out + 4 * i, cv[i]);
+}
+
+void dg_init(void)
+{
+	c32_init();
+#if defined(has_clmul)
+	if (__builtin_cpu_supports("avx2")) {
+		b3_many = b3_many_a;
+		b3_kern = "8-way avx2";
+	}
+#endif
+}
+
+/* returns -1 for an unknown name */
+int dg_type(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof dg_names / sizeof *dg_names); i++)
+		if (!strcmp(name, dg_names[i]))
+			return i;
+	return -1;
+}
+
+const char *dg_name(int type)
+{
+	return dg_names[type];
+}
+
+const char *dg_impl(int type)
+{
+	switch (type) {
+		case DG_CRC32C:
+			return c32_kern;
+		case DG_XXH64:
+			return "scalar";
+		case DG_BLAKE3:
+			return b3_kern;
+		default:
+			return crc_impl();
+	}
+}
+
+void dg_beg(struct dg_s *dg, int type)
+{
+	dg->type = type;
+	switch (type) {
+		case DG_CRC32C:
+			dg->u.c32 = ~(uint32_t)0;
+			break;
+		case DG_XXH64:
+			xx_beg(&dg->u.xx);
+			break;
+		case DG_BLAKE3:
+			b3_beg(&dg->u.b3);
+			break;
+		default:
+			dg->u.crc = crc_beg();
+	}
+}
+
+/* everything but crc32, which is handled inline by dg_calc() */
+void dg_calc_x(struct dg_s *restrict dg, const uint8_t *restrict d, size_t cnt)
+{
+	switch (dg->type) {
+		case DG_CRC32C:
+			dg->u.c32 = cnt >= 8 ? c32_bulk(dg->u.c32, d, cnt) : c32_calc_1(dg->u.c32, d, cnt);
+			break;
+		case DG_XXH64:
+			xx_calc(&dg->u.xx, d, cnt);
+			break;
+		case DG_BLAKE3:
+			b3_calc(&dg->u.b3, d, cnt);
+			break;
+		default:
+			dg->u.crc = crc_calc(dg->u.crc, d, cnt);
+	}
+}
+
+/* printable form of the digest - hex, as printed by the usual tools */
+void dg_end(const struct dg_s *dg, char *str)
+{
+	uint8_t out[32];
+	int i;
+
+	switch (dg->type) {
+		case DG_CRC32C:
+			snprintf(str, DG_STRLEN, "0x%08x", (unsigned int)~dg->u.c32);
+			break;
+		case DG_XXH64:
+			snprintf(str, DG_STRLEN, "%016llx", (unsigned long long)xx_end(&dg->u.xx));
+			break;
+		case DG_BLAKE3:
+			b3_end(&dg->u.b3, out);
+			for (i = 0; i < 32; i++)
+				snprintf(str + 2 * i, 3, "%02x", out[i]);
+			break;
+		default:
+			snprintf(str, DG_STRLEN, "0x%llx", (unsigned long long)crc_end(dg->u.crc));
+	}
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __digest_h__
+#define __digest_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+#include "crc.h"
+
+/*
+ * digests selectable for -c / -C (-x); crc32 is the cksum compatible one from
+ * crc.c and the only one supporting combination (-E <n> with n > 1)
+ */
+#define DG_CRC32  0
+#define DG_CRC32C 1
+#define DG_XXH64  2
+#define DG_BLAKE3 3
+
+/* max. length of a digest's printable form, with the terminating 0 */
+#define DG_STRLEN 72
+
+struct xxh64_s {
+	uint64_t v[4], len;
+	uint8_t mem[32];
+	unsigned int fill;
+};
+
+/*
+ * blake3 hasher (hash mode, 32 byte output) - cv / blk / blen / bcnt describe
+ * the current chunk, stack holds the chaining values of the completed subtrees
+ * (at most one per level)
+ */
+struct b3_s {
+	uint32_t cv[8];
+	uint64_t chunk;
+	uint8_t blk[64];
+	unsigned int blen, bcnt, depth;
+	uint32_t stack[54][8];
+};
+
+/* the state has no pointers, so it can live in the shared buffer */
+struct dg_s {
+	int type;
+	union {
+		CRCINT crc;
+		uint32_t c32;
+		struct xxh64_s xx;
+		struct b3_s b3;
+	} u;
+};
+
+void dg_init(void);
+int dg_type(const char *name);
+const char *dg_name(int type);
+const char *dg_impl(int type);
+void dg_beg(struct dg_s *dg, int type);
+void dg_calc_x(struct dg_s *restrict dg, const uint8_t *restrict d, size_t cnt);
+void dg_end(const struct dg_s *dg, char *str);
+
+static inline void
+dg_calc(struct dg_s *restrict dg, const uint8_t *restrict d, size_t cnt)
+{
+	if likely(dg->type == DG_CRC32)
+		dg->u.crc = crc_calc(dg->u.crc, d, cnt);
+	else
+		dg_calc_x(dg, d, cnt);
+}
+
+#endif
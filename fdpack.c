@@ -27,6 +27,22 @@
 #include <stdint.h>
 #include <limits.h>
 #include <signal.h>
+#ifdef has_falloc
+# include <linux/falloc.h>
+#endif
+#ifdef has_fseg
+# include <pthread.h>
+#endif
+#ifdef has_fmap
+# include <sys/mman.h>
+# ifndef MAP_POPULATE
+#  define MAP_POPULATE 0
+# endif
+#endif
+#ifdef has_dio
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
 #ifndef h_mingw
 # include <sys/socket.h>
 # include <netinet/in_systm.h>
@@ -78,12 +94,50 @@ static int fd_open_f(struct fdpack_s*);
 static int fd_open_s(struct fdpack_s*);
 static int fd_close_(struct fdpack_s*);
 static int fd_close_s(struct fdpack_s*);
+static int fd_close_f(struct fdpack_s*);
+#ifdef has_fmap
+static void fd_info_m(struct fdpack_s*);
+static int fd_open_m(struct fdpack_s*);
+static int fd_close_m(struct fdpack_s*);
+static ssize_t fd_read_m(struct fdpack_s *, void *, size_t);
+static ssize_t fd_write_m(struct fdpack_s *, const void *, size_t);
+static ssize_t fd_readv_m(struct fdpack_s *, const struct iovec *, int);
+static ssize_t fd_writev_m(struct fdpack_s *, const struct iovec *, int);
+static ssize_t fd_readm_m(struct fdpack_s *, const struct iovec *, int, size_t);
+static ssize_t fd_writem_m(struct fdpack_s *, const struct iovec *, int, size_t);
+#endif
+#ifdef has_fseg
+static void fd_info_z(struct fdpack_s*);
+static int fd_open_z(struct fdpack_s*);
+static int fd_close_z(struct fdpack_s*);
+static int fd_dtor_z(struct fdpack_s*);
+static ssize_t fd_write_z(struct fdpack_s *, const void *, size_t);
+static ssize_t fd_writev_z(struct fdpack_s *, const struct iovec *, int);
+static ssize_t fd_writem_z(struct fdpack_s *, const struct iovec *, int, size_t);
+#endif
 static int fd_dtor_(struct fdpack_s*);
 static int fd_dtor_f(struct fdpack_s*);
+static void fd_cache_init(struct fdpack_s*);
+static void fd_cache_fini(struct fdpack_s*);
+static void fd_sparse_fini(struct fdpack_s*);
 static ssize_t fd_read_(struct fdpack_s *, void *, size_t);
 static ssize_t fd_read_s(struct fdpack_s *, void *, size_t);
 static ssize_t fd_write_(struct fdpack_s *, const void *, size_t);
 static ssize_t fd_write_s(struct fdpack_s *, const void *, size_t);
+static ssize_t fd_read_f(struct fdpack_s *, void *, size_t);
+static ssize_t fd_write_f(struct fdpack_s *, const void *, size_t);
+static ssize_t fd_readv_(struct fdpack_s *, const struct iovec *, int);
+static ssize_t fd_readv_s(struct fdpack_s *, const struct iovec *, int);
+static ssize_t fd_readv_f(struct fdpack_s *, const struct iovec *, int);
+static ssize_t fd_writev_(struct fdpack_s *, const struct iovec *, int);
+static ssize_t fd_writev_s(struct fdpack_s *, const struct iovec *, int);
+static ssize_t fd_writev_f(struct fdpack_s *, const struct iovec *, int);
+static ssize_t fd_readm_(struct fdpack_s *, const struct iovec *, int, size_t);
+static ssize_t fd_readm_s(struct fdpack_s *, const struct iovec *, int, size_t);
+static ssize_t fd_readm_f(struct fdpack_s *, const struct iovec *, int, size_t);
+static ssize_t fd_writem_(struct fdpack_s *, const struct iovec *, int, size_t);
+static ssize_t fd_writem_s(struct fdpack_s *, const struct iovec *, int, size_t);
+static ssize_t fd_writem_f(struct fdpack_s *, const struct iovec *, int, size_t);
 
 const struct fdtype_s _fdfd = {
 		.kind = "fd",
@@ -92,17 +146,55 @@ const struct fdtype_s _fdfd = {
 		.close = &fd_close_,
 		.read = &fd_read_,
 		.write = &fd_write_,
+		.readv = &fd_readv_,
+		.writev = &fd_writev_,
+		.readm = &fd_readm_,
+		.writem = &fd_writem_,
 		.info = &fd_info_,
 };
 const struct fdtype_s _fdfile = {
 		.kind = "file",
 		.dtor = &fd_dtor_f,
 		.open = &fd_open_f,
-		.close = &fd_close_,
-		.read = &fd_read_,
-		.write = &fd_write_,
+		.close = &fd_close_f,
+		.read = &fd_read_f,
+		.write = &fd_write_f,
+		.readv = &fd_readv_f,
+		.writev = &fd_writev_f,
+		.readm = &fd_readm_f,
+		.writem = &fd_writem_f,
 		.info = &fd_info_f,
 };
+#ifdef has_fmap
+const struct fdtype_s _fdmap = {
+		.kind = "mmap",
+		.dtor = &fd_dtor_f,
+		.open = &fd_open_m,
+		.close = &fd_close_m,
+		.read = &fd_read_m,
+		.write = &fd_write_m,
+		.readv = &fd_readv_m,
+		.writev = &fd_writev_m,
+		.readm = &fd_readm_m,
+		.writem = &fd_writem_m,
+		.info = &fd_info_m,
+};
+#endif
+#ifdef has_fseg
+const struct fdtype_s _fdseg = {
+		.kind = "segments",
+		.dtor = &fd_dtor_z,
+		.open = &fd_open_z,
+		.close = &fd_close_z,
+		.read = &fd_read_f,
+		.write = &fd_write_z,
+		.readv = &fd_readv_f,
+		.writev = &fd_writev_z,
+		.readm = &fd_readm_f,
+		.writem = &fd_writem_z,
+		.info = &fd_info_z,
+};
+#endif
 
 const struct fdtype_s _fdsock = {
 		.kind = "socket",
@@ -111,6 +203,10 @@ const struct fdtype_s _fdsock = {
 		.close = &fd_close_s,
 		.read = &fd_read_s,
 		.write = &fd_write_s,
+		.readv = &fd_readv_s,
+		.writev = &fd_writev_s,
+		.readm = &fd_readm_s,
+		.writem = &fd_writem_s,
 		.info = &fd_info_s,
 };
 
@@ -131,8 +227,31 @@ fd_info_f(struct fdpack_s *fd)
 {
 	fd_info_(fd);
 	fprintf(stderr,"  path:  %s\n", fd->f.path);
+	if (fd->f.dblk)
+		fputs("  direct i/o requested\n", stderr);
+	if (fd->f.psiz || fd->f.pchunk) {
+		fprintf(stderr, "  prealloc: %lld", (long long)fd->f.psiz);
+		if (fd->f.pchunk)
+			fprintf(stderr, " (chunks of %zu)", fd->f.pchunk);
+		fputc('\n', stderr);
+	}
+	if (fd->f.sblk) {
+		if (fd->dir)
+			fprintf(stderr, "  sparse: zero blocks of %zu\n", fd->f.sblk);
+		else
+			fputs("  sparse: holes skipped\n", stderr);
+	}
 }
 
+#ifdef has_fmap
+static void
+fd_info_m(struct fdpack_s *fd)
+{
+	fd_info_(fd);
+	fprintf(stderr,"  path:  %s\n  window: %zu\n", fd->f.path, fd->f.mwin);
+}
+#endif
+
 static void
 fd_info_s(struct fdpack_s *fd)
 {
@@ -176,6 +295,7 @@ fd_close_(struct fdpack_s *fd)
 {
 	int ret = -1;
 	if (fd->fd >= 0) {
+		fd_cache_fini(fd);
 		if (fd->sync)
 #ifdef h_mingw
 			_commit(fd->fd);
@@ -189,6 +309,29 @@ fd_close_(struct fdpack_s *fd)
 	return ret;
 }
 
+/*
+ * trim the file to what was written - that releases the preallocated space
+ * past the end, and with the expected size known, drops the strict mode pad
+ * as well (only the pad bytes reported by the writer, so the data is never
+ * cut, even if the size was off)
+ */
+static int
+fd_close_f(struct fdpack_s *fd)
+{
+	off_t end;
+
+	if (fd->fd >= 0 && (fd->f.psiz || fd->f.pchunk || (fd->dir && fd->f.sblk)) && (end = lseek(fd->fd, 0, SEEK_CUR)) >= 0) {
+		if (fd->f.psiz && fd->f.ppad && fd->f.ppad <= end) {
+			fprintf(stderr, "INFO: %s: truncating the %lld byte pad\n", fd->f.path, (long long)fd->f.ppad);
+			end -= fd->f.ppad;
+		}
+		fd_sparse_fini(fd);
+		if (ftruncate(fd->fd, end) < 0)
+			perror("ftruncate()");
+	}
+	return fd_close_(fd);
+}
+
 static int
 fd_close_s(struct fdpack_s *fd)
 {
@@ -229,10 +372,117 @@ fd_dtor_f(struct fdpack_s *fd)
 	return fd_dtor_(fd);
 }
 
+/*
+ * page cache policy - for regular files only, whether opened by us or passed
+ * as fds; cpos follows the transfer
+ *
+ * reader: sequential access hint, plus explicit readahead() of the window
+ * ahead of cpos (cmark is the end of what was requested so far)
+ *
+ * writer: write-behind - once a window's worth of data is written, its
+ * writeback is started, then we wait for the previous window (cprev..cmark)
+ * and drop it from the cache; so the amount of dirty / cached data stays
+ * around 2 windows, and the final fsync (if any) is short
+ */
+#ifdef has_fcache
+static void
+fd_cache_r(struct fdpack_s *fd, size_t cnt)
+{
+	off_t end, beg;
+
+	fd->cpos += (off_t)cnt;
+	end = fd->cpos + (off_t)fd->cwin;
+	beg = Y_MAX(fd->cmark, fd->cpos);
+	if (end - beg < (off_t)fd->cwin / 2)
+		return;
+	readahead(fd->fd, beg, (size_t)(end - beg));
+	fd->cmark = end;
+}
+
+static void
+fd_cache_w(struct fdpack_s *fd, size_t cnt)
+{
+	fd->cpos += (off_t)cnt;
+	if (fd->cpos - fd->cmark < (off_t)fd->cwin)
+		return;
+	sync_file_range(fd->fd, fd->cmark, fd->cpos - fd->cmark, SYNC_FILE_RANGE_WRITE);
+	if (fd->cmark > fd->cprev) {
+		sync_file_range(fd->fd, fd->cprev, fd->cmark - fd->cprev,
+			SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+		posix_fadvise(fd->fd, fd->cprev, fd->cmark - fd->cprev, POSIX_FADV_DONTNEED);
+	}
+	fd->cprev = fd->cmark;
+	fd->cmark = fd->cpos;
+}
+#endif
+
+static void
+fd_cache_init(struct fdpack_s *fd)
+{
+#ifdef has_fcache
+	struct stat st;
+
+	if (!fd->cwin)
+		return;
+	if (fstat(fd->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "INFO: fd %d: cache policy applies to regular files only\n", fd->fd);
+		fd->cwin = 0;
+		return;
+	}
+	if ((fd->cpos = lseek(fd->fd, 0, SEEK_CUR)) < 0)
+		fd->cpos = 0;
+	fd->cmark = fd->cprev = fd->cpos;
+	if (!fd->dir) {
+		posix_fadvise(fd->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		fd_cache_r(fd, 0);
+	}
+	fprintf(stderr, "%s on fd %d, window: %zu\n", fd->dir ? "Write-behind" : "Readahead", fd->fd, fd->cwin);
+#else
+	fd->cwin = 0;
+#endif
+}
+
+/*
+ * the rest of the written data - so the cache is left clean; cwin is the
+ * configuration (set once, kept across reopens), only the positions go
+ */
+static void
+fd_cache_fini(struct fdpack_s *fd)
+{
+#ifdef has_fcache
+	if (!fd->cwin)
+		return;
+	if (fd->dir) {
+		sync_file_range(fd->fd, fd->cprev, 0,
+			SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+		posix_fadvise(fd->fd, fd->cprev, 0, POSIX_FADV_DONTNEED);
+	}
+	fd->cpos = fd->cmark = fd->cprev = 0;
+#else
+	(void)fd;
+#endif
+}
+
+static inline ssize_t
+fd_cache(struct fdpack_s *fd, ssize_t ret)
+{
+#ifdef has_fcache
+	if (unlikely(fd->cwin) && ret > 0) {
+		if (fd->dir)
+			fd_cache_w(fd, (size_t)ret);
+		else
+			fd_cache_r(fd, (size_t)ret);
+	}
+#else
+	(void)fd;
+#endif
+	return ret;
+}
+
 static ssize_t
 fd_read_(struct fdpack_s *fd, void *buf, size_t count)
 {
-	return read(fd->fd, buf, count);
+	return fd_cache(fd, read(fd->fd, buf, count));
 }
 
 static ssize_t
@@ -244,7 +494,7 @@ fd_read_s(struct fdpack_s *fd, void *buf, size_t count)
 static ssize_t
 fd_write_(struct fdpack_s *fd, const void *buf, size_t count)
 {
-	return write(fd->fd, buf, count);
+	return fd_cache(fd, write(fd->fd, buf, count));
 }
 
 static ssize_t
@@ -253,12 +503,732 @@ fd_write_s(struct fdpack_s *fd, const void *buf, size_t count)
 	return send_wr(fd->s.fds, buf, count, MSG_NOSIGNAL);
 }
 
+/*
+ * preallocation - with a known size and no chunk, everything is allocated at
+ * open; with a chunk, the allocation is kept up to a chunk ahead of the
+ * writer (never past the expected size, if it's known); FALLOC_FL_KEEP_SIZE
+ * is used, so the file grows with the writes as usual - whatever is left
+ * allocated past the end is released at close
+ */
+#ifdef has_falloc
+static void
+fd_prealloc(struct fdpack_s *fd, off_t len)
+{
+	if (fd->f.plim && fd->f.pend + len > fd->f.plim)
+		len = fd->f.plim - fd->f.pend;
+	if (len <= 0)
+		return;
+	if (fallocate(fd->fd, FALLOC_FL_KEEP_SIZE, fd->f.pend, len) < 0) {
+		fprintf(stderr, "INFO: %s: preallocation failed: %s\n", fd->f.path, strerror(errno));
+		/* until the next open */
+		fd->f.pstep = 0;
+		return;
+	}
+	fd->f.pend += len;
+}
+#endif
+
+static void
+fd_prealloc_init(struct fdpack_s *fd)
+{
+	fd->f.ppad = 0;
+	fd->f.pstep = 0;
+#ifdef has_falloc
+	if (!fd->f.psiz && !fd->f.pchunk)
+		return;
+	if ((fd->f.ppos = lseek(fd->fd, 0, SEEK_CUR)) < 0)
+		fd->f.ppos = 0;
+	fd->f.pend = fd->f.ppos;
+	fd->f.plim = fd->f.psiz ? fd->f.ppos + fd->f.psiz : 0;
+	fd->f.pstep = fd->f.pchunk;
+	fd_prealloc(fd, fd->f.pstep ? (off_t)fd->f.pstep : fd->f.psiz);
+#endif
+}
+
+static inline ssize_t
+fd_prealloc_w(struct fdpack_s *fd, ssize_t ret)
+{
+#ifdef has_falloc
+	if (unlikely(fd->f.pstep) && ret > 0) {
+		fd->f.ppos += ret;
+		if (fd->f.ppos + (off_t)fd->f.pstep / 2 > fd->f.pend)
+			fd_prealloc(fd, (off_t)fd->f.pstep);
+	}
+#else
+	(void)fd;
+#endif
+	return ret;
+}
+
+/*
+ * sparse input - the data / hole extent around the current position is
+ * looked up with SEEK_DATA / SEEK_HOLE whenever the previous one is used up;
+ * holes are produced with memset() and skipped over, data reads are cut at
+ * the start of the next hole (callers handle short reads anyway)
+ */
+static void
+fd_sparse_init(struct fdpack_s *fd)
+{
+#ifdef has_sparse
+	struct stat st;
+
+	if (!fd->f.sblk)
+		return;
+	if (fstat(fd->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "INFO: %s: sparse mode applies to regular files only\n", fd->f.path);
+		fd->f.sblk = 0;
+		return;
+	}
+	if ((fd->f.spos = lseek(fd->fd, 0, SEEK_CUR)) < 0)
+		fd->f.spos = 0;
+	fd->f.sdat = fd->f.shol = fd->f.spos;
+#else
+	fd->f.sblk = 0;
+#endif
+}
+
+#ifdef has_sparse
+static int
+fd_sparse_ext(struct fdpack_s *fd)
+{
+	struct stat st;
+	off_t pos = fd->f.spos, dat, hol, end = -1;
+
+	if ((dat = lseek(fd->fd, pos, SEEK_DATA)) < 0) {
+		/* hole up to the end of file, or at / past it */
+		if (errno != ENXIO || fstat(fd->fd, &st) < 0)
+			goto out;
+		dat = end = Y_MAX(st.st_size, pos);
+	}
+	if (dat > pos)
+		hol = dat;
+	else if (dat == end)
+		hol = dat + (off_t)SSIZE_MAX;
+	else if ((hol = lseek(fd->fd, pos, SEEK_HOLE)) < 0)
+		goto out;
+	if (lseek(fd->fd, pos, SEEK_SET) < 0)
+		goto out;
+	fd->f.sdat = dat;
+	fd->f.shol = hol;
+	return 0;
+out:
+	fprintf(stderr, "INFO: %s: hole lookup failed, sparse mode disabled: %s\n", fd->f.path, strerror(errno));
+	lseek(fd->fd, pos, SEEK_SET);
+	fd->f.sblk = 0;
+	return -1;
+}
+
+static ssize_t
+fd_sparse_r(struct fdpack_s *fd, void *buf, size_t count)
+{
+	ssize_t ret;
+	size_t n;
+
+	if (fd->f.spos >= fd->f.shol && fd_sparse_ext(fd) < 0)
+		return fd_read_(fd, buf, count);
+	if (fd->f.spos < fd->f.sdat) {
+		n = (size_t)Y_MIN((off_t)count, fd->f.sdat - fd->f.spos);
+		memset(buf, 0, n);
+		if (lseek(fd->fd, (off_t)n, SEEK_CUR) < 0)
+			return -1;
+		fd->f.spos += (off_t)n;
+		fd->f.selid += n;
+		return fd_cache(fd, (ssize_t)n);
+	}
+	n = (size_t)Y_MIN((off_t)count, fd->f.shol - fd->f.spos);
+	if ((ret = fd_read_(fd, buf, n)) > 0)
+		fd->f.spos += ret;
+	return ret;
+}
+#endif
+
+static ssize_t
+fd_read_f(struct fdpack_s *fd, void *buf, size_t count)
+{
+#ifdef has_sparse
+	if (unlikely(fd->f.sblk))
+		return fd_sparse_r(fd, buf, count);
+#endif
+	return fd_read_(fd, buf, count);
+}
+
+/*
+ * sparse output - a run of all-zero blocks at the front of the write is
+ * skipped with lseek(); otherwise the write goes up to the next zero block;
+ * the file gets its final size at close, in case it ends with a hole
+ *
+ * skipped runs over preallocated space have to be punched out - adjacent
+ * runs are merged first, so small blocks still free whole filesystem blocks
+ */
+static void
+fd_sparse_punch(struct fdpack_s *fd)
+{
+#if defined(has_sparse) && defined(has_falloc)
+	struct stat st;
+
+	if (fd->f.spe <= fd->f.sph)
+		return;
+	/* punching is a no-op past the end of file, so extend it first */
+	if (fstat(fd->fd, &st) < 0 || (st.st_size < fd->f.spe && ftruncate(fd->fd, fd->f.spe) < 0) ||
+	    fallocate(fd->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, fd->f.sph, fd->f.spe - fd->f.sph) < 0)
+		perror("fallocate()");
+	fd->f.sph = fd->f.spe = 0;
+#else
+	(void)fd;
+#endif
+}
+
+static void
+fd_sparse_fini(struct fdpack_s *fd)
+{
+	if (fd->dir && fd->f.sblk)
+		fd_sparse_punch(fd);
+}
+
+#ifdef has_sparse
+static size_t
+fd_sparse_w(struct fdpack_s *fd, const void *buf, size_t count)
+{
+	const uint8_t *ptr = buf;
+	size_t blk = fd->f.sblk, n = 0;
+	off_t pos;
+
+	while (n + blk <= count && is_zero(ptr + n, blk))
+		n += blk;
+	if (!n)
+		return 0;
+	if ((pos = lseek(fd->fd, (off_t)n, SEEK_CUR)) < 0)
+		return 0;
+	pos -= (off_t)n;
+	if (fd->f.pend > pos) {
+		if (fd->f.spe != pos)
+			fd_sparse_punch(fd);
+		if (fd->f.spe == fd->f.sph)
+			fd->f.sph = pos;
+		fd->f.spe = pos + (off_t)n;
+	}
+	fd->f.selid += n;
+	return n;
+}
+
+static size_t
+fd_dense_w(struct fdpack_s *fd, const void *buf, size_t count)
+{
+	const uint8_t *ptr = buf;
+	size_t blk = fd->f.sblk, n = blk;
+
+	while (n + blk <= count && !is_zero(ptr + n, blk))
+		n += blk;
+	return n + blk > count ? count : n;
+}
+#endif
+
+/*
+ * direct i/o - everything is aligned, except possibly the tail at the end of
+ * the transfer; that one is written through the page cache (for the rest of
+ * the transfer, as it can only be the last write)
+ */
+static ssize_t
+fd_write_f(struct fdpack_s *fd, const void *buf, size_t count)
+{
+#ifdef has_sparse
+	size_t n;
+
+	if (unlikely(fd->f.sblk) && count >= fd->f.sblk) {
+		if ((n = fd_sparse_w(fd, buf, count)))
+			return fd_prealloc_w(fd, fd_cache(fd, (ssize_t)n));
+		count = fd_dense_w(fd, buf, count);
+		fd_sparse_punch(fd);
+	}
+#endif
+	if (unlikely(fd->f.dio) && count % fd->f.dio)
+		fd_nodirect(fd);
+	return fd_prealloc_w(fd, fd_write_(fd, buf, count));
+}
+
+/*
+ * vectored variants; on mingw there's no readv() / writev(), so files are
+ * handled by consecutive calls (stopping at the first short one), and sockets
+ * go through WSARecv() / WSASend() to keep datagrams in one piece
+ */
+static ssize_t
+fd_readv_(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+#ifndef h_mingw
+	return fd_cache(fd, readv(fd->fd, iov, cnt));
+#else
+	ssize_t ret, tot = 0;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		ret = read(fd->fd, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0)
+			return tot ? tot : ret;
+		tot += ret;
+		if ((size_t)ret < iov[i].iov_len)
+			break;
+	}
+	return tot;
+#endif
+}
+
+static ssize_t
+fd_writev_(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+#ifndef h_mingw
+	return fd_cache(fd, writev(fd->fd, iov, cnt));
+#else
+	ssize_t ret, tot = 0;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		ret = write(fd->fd, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0)
+			return tot ? tot : ret;
+		tot += ret;
+		if ((size_t)ret < iov[i].iov_len)
+			break;
+	}
+	return tot;
+#endif
+}
+
+/* in sparse mode, only the first part is handled per call */
+static ssize_t
+fd_readv_f(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+	if (unlikely(fd->f.sblk))
+		return fd_read_f(fd, iov[0].iov_base, iov[0].iov_len);
+	return fd_readv_(fd, iov, cnt);
+}
+
+static ssize_t
+fd_writev_f(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+	size_t tot = 0;
+	int i;
+
+	if (unlikely(fd->f.sblk))
+		return fd_write_f(fd, iov[0].iov_base, iov[0].iov_len);
+
+	if unlikely(fd->f.dio) {
+		for (i = 0; i < cnt; i++)
+			tot += iov[i].iov_len;
+		if (tot % fd->f.dio)
+			fd_nodirect(fd);
+	}
+	return fd_prealloc_w(fd, fd_writev_(fd, iov, cnt));
+}
+
+static ssize_t
+fd_readv_s(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+#ifndef h_mingw
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = (size_t)cnt;
+	return recvmsg(fd->s.fds, &msg, fd->s.flags);
+#else
+	WSABUF wb[2];
+	DWORD got, flags = (DWORD)fd->s.flags;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		wb[i].buf = (char *)iov[i].iov_base;
+		wb[i].len = (u_long)iov[i].iov_len;
+	}
+	if (WSARecv(fd->s.fds, wb, (DWORD)cnt, &got, &flags, NULL, NULL) == SOCKET_ERROR)
+		return -1;
+	return (ssize_t)got;
+#endif
+}
+
+static ssize_t
+fd_writev_s(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+#ifndef h_mingw
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = (size_t)cnt;
+	return sendmsg(fd->s.fds, &msg, MSG_NOSIGNAL);
+#else
+	WSABUF wb[2];
+	DWORD put;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		wb[i].buf = (char *)iov[i].iov_base;
+		wb[i].len = (u_long)iov[i].iov_len;
+	}
+	if (WSASend(fd->s.fds, wb, (DWORD)cnt, &put, 0, NULL, NULL) == SOCKET_ERROR)
+		return -1;
+	return (ssize_t)put;
+#endif
+}
+
+static ssize_t
+fd_readm_(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk __attribute__ ((__unused__)))
+{
+	return fd_readv_(fd, iov, cnt);
+}
+
+static ssize_t
+fd_writem_(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk __attribute__ ((__unused__)))
+{
+	return fd_writev_(fd, iov, cnt);
+}
+
+#ifdef has_fmap
+/*
+ * mmap files - accessed through a window of mwin bytes, moved along with the
+ * transfer; the input is mapped read-only with sequential access advice; the
+ * output is extended one window at a time with posix_fallocate(), so a full
+ * filesystem shows up as a write error instead of SIGBUS; windows are
+ * populated when mapped, instead of faulting page by page; writeback of a
+ * window is started when it's unmapped, and the file is trimmed to what was
+ * written at close
+ */
+static void
+fd_map_drop(struct fdpack_s *fd)
+{
+	if (!fd->f.mptr)
+		return;
+	if (fd->dir)
+		msync(fd->f.mptr, fd->f.mlen, MS_ASYNC);
+	munmap(fd->f.mptr, fd->f.mlen);
+	fd->f.mptr = NULL;
+	fd->f.mlen = 0;
+}
+
+/* make sure the window covers mpos, returns the length available from it */
+static ssize_t
+fd_map_win(struct fdpack_s *fd)
+{
+	off_t base, len;
+	int err;
+
+	if (fd->f.mptr && fd->f.mpos >= fd->f.mbase && fd->f.mpos < fd->f.mbase + (off_t)fd->f.mlen)
+		goto out;
+	fd_map_drop(fd);
+	base = fd->f.mpos - fd->f.mpos % (off_t)get_page();
+	len = (off_t)fd->f.mwin;
+	if (!fd->dir) {
+		if (fd->f.mpos >= fd->f.mend)
+			return 0;
+		len = Y_MIN(len, fd->f.mend - base);
+	} else if ((err = posix_fallocate(fd->fd, base, len))) {
+		errno = err;
+		return -1;
+	}
+	fd->f.mptr = mmap(NULL, (size_t)len, fd->dir ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED | MAP_POPULATE, fd->fd, base);
+	if (fd->f.mptr == MAP_FAILED) {
+		fd->f.mptr = NULL;
+		return -1;
+	}
+	if (!fd->dir)
+		madvise(fd->f.mptr, (size_t)len, MADV_SEQUENTIAL);
+	fd->f.mbase = base;
+	fd->f.mlen = (size_t)len;
+out:
+	return (ssize_t)(fd->f.mbase + (off_t)fd->f.mlen - fd->f.mpos);
+}
+
+ssize_t
+fd_map_peek(struct fdpack_s *fd, const void **ptr, size_t max)
+{
+	ssize_t ret;
+
+	if ((ret = fd_map_win(fd)) > 0) {
+		*ptr = fd->f.mptr + (fd->f.mpos - fd->f.mbase);
+		ret = Y_MIN(ret, (ssize_t)max);
+	}
+	return ret;
+}
+
+static int
+fd_open_m(struct fdpack_s *fd)
+{
+	struct stat st;
+
+	if (fd_open_f(fd) < 0)
+		return -1;
+	if (fstat(fd->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "%s: mmap applies to regular files only\n", fd->f.path);
+		fd_close_(fd);
+		return -1;
+	}
+	if ((fd->f.mpos = lseek(fd->fd, 0, SEEK_CUR)) < 0)
+		fd->f.mpos = 0;
+	fd->f.mend = st.st_size;
+	return 0;
+}
+
+static int
+fd_close_m(struct fdpack_s *fd)
+{
+	fd_map_drop(fd);
+	if (fd->fd >= 0 && fd->dir && ftruncate(fd->fd, fd->f.mpos) < 0)
+		perror("ftruncate()");
+	return fd_close_(fd);
+}
+
+static ssize_t
+fd_read_m(struct fdpack_s *fd, void *buf, size_t count)
+{
+	ssize_t ret;
+
+	if ((ret = fd_map_win(fd)) <= 0)
+		return ret;
+	ret = Y_MIN(ret, (ssize_t)count);
+	memcpy(buf, fd->f.mptr + (fd->f.mpos - fd->f.mbase), (size_t)ret);
+	fd->f.mpos += ret;
+	return ret;
+}
+
+static ssize_t
+fd_write_m(struct fdpack_s *fd, const void *buf, size_t count)
+{
+	ssize_t ret;
+
+	if ((ret = fd_map_win(fd)) <= 0)
+		return ret;
+	ret = Y_MIN(ret, (ssize_t)count);
+	memcpy(fd->f.mptr + (fd->f.mpos - fd->f.mbase), buf, (size_t)ret);
+	fd->f.mpos += ret;
+	return ret;
+}
+
+/* window boundaries split the vectored variants, like short reads / writes */
+static ssize_t
+fd_readv_m(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+	ssize_t ret, tot = 0;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		ret = fd_read_m(fd, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0)
+			return tot ? tot : ret;
+		tot += ret;
+		if ((size_t)ret < iov[i].iov_len)
+			break;
+	}
+	return tot;
+}
+
+static ssize_t
+fd_writev_m(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+	ssize_t ret, tot = 0;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		ret = fd_write_m(fd, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0)
+			return tot ? tot : ret;
+		tot += ret;
+		if ((size_t)ret < iov[i].iov_len)
+			break;
+	}
+	return tot;
+}
+
+static ssize_t
+fd_readm_m(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk __attribute__ ((__unused__)))
+{
+	return fd_readv_m(fd, iov, cnt);
+}
+
+static ssize_t
+fd_writem_m(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk __attribute__ ((__unused__)))
+{
+	return fd_writev_m(fd, iov, cnt);
+}
+#else
+ssize_t
+fd_map_peek(struct fdpack_s *fd __attribute__ ((__unused__)), const void **ptr __attribute__ ((__unused__)), size_t max __attribute__ ((__unused__)))
+{
+	return -1;
+}
+#endif
+
+/*
+ * datagram sockets - every block is a separate datagram, so batches go
+ * through recvmmsg() / sendmmsg(); received datagrams shorter than blk are
+ * compacted, so the data in the buffer remains contiguous; only the first
+ * (contiguous) iovec is used for receiving
+ */
+#define MMSG_MAX 64
+
+static ssize_t
+fd_writem_f(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk __attribute__ ((__unused__)))
+{
+	return fd_writev_f(fd, iov, cnt);
+}
+
+static ssize_t
+fd_readm_f(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk __attribute__ ((__unused__)))
+{
+	return fd_readv_f(fd, iov, cnt);
+}
+
+static ssize_t
+fd_readm_s(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk)
+{
+#ifdef has_mmsg
+	struct mmsghdr mh[MMSG_MAX];
+	struct iovec miov[MMSG_MAX];
+	uint8_t *ptr = iov[0].iov_base;
+	size_t i, n, off;
+	int ret;
+
+	n = Y_MIN(iov[0].iov_len / blk, MMSG_MAX);
+	if (fd->s.np.dom != IPPROTO_UDP || n < 2)
+		return fd_readv_s(fd, iov, cnt);
+
+	memset(mh, 0, n * sizeof *mh);
+	for (i = 0; i < n; i++) {
+		miov[i].iov_base = ptr + i*blk;
+		miov[i].iov_len = blk;
+		mh[i].msg_hdr.msg_iov = &miov[i];
+		mh[i].msg_hdr.msg_iovlen = 1;
+	}
+	/* block only until the first datagram arrives */
+	ret = recvmmsg(fd->s.fds, mh, (unsigned int)n, MSG_WAITFORONE, NULL);
+	if (ret <= 0)
+		return ret;
+	for (i = 0, off = 0; i < (size_t)ret; i++) {
+		if (off != i*blk)
+			memmove(ptr + off, ptr + i*blk, mh[i].msg_len);
+		off += mh[i].msg_len;
+	}
+	return (ssize_t)off;
+#else
+	(void)blk;
+	return fd_readv_s(fd, iov, cnt);
+#endif
+}
+
+static ssize_t
+fd_writem_s(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk)
+{
+#ifdef has_mmsg
+	struct mmsghdr mh[MMSG_MAX];
+	struct iovec miov[2*MMSG_MAX];
+	size_t want, take, off = 0, tot = 0;
+	int i, j = 0, k = 0, m;
+
+	if (fd->s.np.dom != IPPROTO_UDP)
+		return fd_writev_s(fd, iov, cnt);
+
+	/* split the iovecs into blk sized datagrams (2 iovecs max. per one) */
+	memset(mh, 0, sizeof mh);
+	for (m = 0; m < MMSG_MAX && j < cnt; m++) {
+		mh[m].msg_hdr.msg_iov = &miov[k];
+		for (want = blk; want && j < cnt; k++) {
+			take = Y_MIN(want, iov[j].iov_len - off);
+			miov[k].iov_base = (uint8_t *)iov[j].iov_base + off;
+			miov[k].iov_len = take;
+			mh[m].msg_hdr.msg_iovlen++;
+			want -= take;
+			off += take;
+			if (off == iov[j].iov_len) {
+				j++;
+				off = 0;
+			}
+		}
+	}
+	m = sendmmsg(fd->s.fds, mh, (unsigned int)m, MSG_NOSIGNAL);
+	if (m < 0)
+		return -1;
+	for (i = 0; i < m; i++)
+		tot += mh[i].msg_len;
+	return (ssize_t)tot;
+#else
+	(void)blk;
+	return fd_writev_s(fd, iov, cnt);
+#endif
+}
+
+/*
+ * direct i/o is enabled only after the file is opened, as we need it to find
+ * out the required alignment - if the block size doesn't match it, or the
+ * filesystem doesn't support it at all, we stay with regular i/o; the buffer
+ * itself is page aligned, and so is every block in it
+ */
+static void
+fd_direct(struct fdpack_s *fd)
+{
+#ifdef has_dio
+	struct stat st;
+	size_t al = 0;
+	long int pg = sysconf(_SC_PAGESIZE);
+	int fl, ssz;
+# ifdef STATX_DIOALIGN
+	struct statx stx;
+# endif
+
+	if (fstat(fd->fd, &st) < 0)
+		goto outb;
+	if (S_ISBLK(st.st_mode)) {
+		if (!ioctl(fd->fd, BLKSSZGET, &ssz))
+			al = (size_t)ssz;
+	}
+# ifdef STATX_DIOALIGN
+	else if (!statx(fd->fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) && (stx.stx_mask & STATX_DIOALIGN)) {
+		if (!stx.stx_dio_offset_align) {
+			fprintf(stderr, "INFO: %s: filesystem doesn't support direct i/o\n", fd->f.path);
+			goto outb;
+		}
+		al = Y_MAX(stx.stx_dio_offset_align, stx.stx_dio_mem_align);
+	}
+# endif
+	if (!al)
+		al = (size_t)st.st_blksize;
+	if (!al || fd->f.dblk % al || (pg > 0 && al > (size_t)pg)) {
+		fprintf(stderr, "INFO: %s: block size %zu doesn't match direct i/o alignment %zu\n", fd->f.path, fd->f.dblk, al);
+		goto outb;
+	}
+	if ((fl = fcntl(fd->fd, F_GETFL)) < 0 || fcntl(fd->fd, F_SETFL, fl | O_DIRECT) < 0) {
+		fprintf(stderr, "INFO: %s: couldn't enable direct i/o: %s\n", fd->f.path, strerror(errno));
+		goto outb;
+	}
+	fd->f.dio = al;
+	fprintf(stderr, "Direct i/o on %s, alignment: %zu\n", fd->f.path, al);
+	return;
+outb:
+#endif
+	fprintf(stderr, "INFO: %s: using regular i/o\n", fd->f.path);
+}
+
+/* e.g. for the unaligned tail */
+int fd_nodirect(struct fdpack_s *fd)
+{
+#ifdef has_dio
+	int fl;
+
+	fd->f.dio = 0;
+	if ((fl = fcntl(fd->fd, F_GETFL)) < 0 || fcntl(fd->fd, F_SETFL, fl & ~O_DIRECT) < 0) {
+		perror("fcntl()");
+		return -1;
+	}
+#else
+	fd->f.dio = 0;
+#endif
+	return 0;
+}
+
 static int
 fd_open_(struct fdpack_s* fd)
 {
 	/* note: direct file descriptor can't be reopened */
 	if (!fd || fd->fd < 0)
 		return -1;
+	fd_cache_init(fd);
 	return 0;
 }
 
@@ -270,7 +1240,12 @@ fd_open_f(struct fdpack_s* fd)
 	if (!fd || fd->fd != -1)
 		goto out;
 	if (fd->dir) {
+		/* shared writable mappings need a descriptor open for reading */
+#ifdef has_fmap
+		mode = (fd->type == &_fdmap ? O_RDWR : O_WRONLY) | O_TRUNC | O_CREAT;
+#else
 		mode = O_WRONLY | O_TRUNC | O_CREAT;
+#endif
 		flags = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
 	} else {
 		mode = O_RDONLY;
@@ -286,6 +1261,13 @@ fd_open_f(struct fdpack_s* fd)
 
 	fd->fd = ret;
 	ret = 0;
+	if (fd->f.dblk)
+		fd_direct(fd);
+	fd_cache_init(fd);
+	if (fd->dir)
+		fd_prealloc_init(fd);
+	else
+		fd_sparse_init(fd);
 out:
 	return ret;
 }
@@ -421,7 +1403,312 @@ out:
 	return -1;
 }
 
-int fd_ctor_f(struct fdpack_s* fd, int dir, const char *path, int sync)
+/*
+ * segmented output - the stream is written into <path>.00000, <path>.00001,
+ * ... of (at most) zsiz bytes each; with a record size, a write never
+ * straddles two segments (the segment is cut early instead)
+ *
+ * the helper thread keeps the next segment opened (and preallocated) ahead of
+ * the writer, and takes the completed ones off its hands - they're trimmed,
+ * optionally fsynced, and closed there, so a rotation is just a descriptor
+ * swap under the mutex
+ */
+#ifdef has_fseg
+#define SEG_QUEUE 8
+
+struct fdseg_s {
+	pthread_t thr;
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	off_t siz, pos, qlen[SEG_QUEUE];
+	size_t rec, qhead, qcnt;
+	unsigned int idx, nidx, qidx[SEG_QUEUE];
+	int nfd, qfd[SEG_QUEUE], err, stop, started;
+};
+
+static int
+fd_seg_open(struct fdpack_s *fd, unsigned int idx)
+{
+	char name[strlen(fd->f.path) + 24];
+	int ret;
+
+	snprintf(name, sizeof name, "%s.%05u", fd->f.path, idx);
+	ret = open(name, O_WRONLY | O_TRUNC | O_CREAT | _O_BINARY | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (ret < 0) {
+		fprintf(stderr, "open(%s): %s\n", name, strerror(errno));
+		return -1;
+	}
+#ifdef has_falloc
+	/* failure is not an error, it's just a hint */
+	if (fallocate(ret, FALLOC_FL_KEEP_SIZE, 0, fd->f.seg->siz) < 0 && !idx)
+		fprintf(stderr, "INFO: %s: preallocation failed: %s\n", name, strerror(errno));
+#endif
+	return ret;
+}
+
+static int
+fd_seg_fini(struct fdpack_s *fd, int sfd, off_t len, unsigned int idx)
+{
+	int ret = 0;
+
+	/* releases the preallocated space past the end */
+	if (len < fd->f.seg->siz && ftruncate(sfd, len) < 0)
+		ret = -1;
+	if (fd->sync && fsync(sfd) < 0)
+		ret = -1;
+	if (TFR(close(sfd)) < 0)
+		ret = -1;
+	if (ret < 0)
+		fprintf(stderr, "Closing segment %s.%05u failed: %s\n", fd->f.path, idx, strerror(errno));
+	return ret;
+}
+
+static void *
+fd_seg_task(void *arg)
+{
+	struct fdpack_s *fd = arg;
+	struct fdseg_s *s = fd->f.seg;
+	unsigned int idx;
+	off_t len;
+	int sfd;
+
+	pthread_mutex_lock(&s->mtx);
+	while (1) {
+		if (s->qcnt) {
+			sfd = s->qfd[s->qhead];
+			len = s->qlen[s->qhead];
+			idx = s->qidx[s->qhead];
+			s->qhead = (s->qhead + 1) % SEG_QUEUE;
+			s->qcnt--;
+			pthread_cond_broadcast(&s->cv);
+			pthread_mutex_unlock(&s->mtx);
+			sfd = fd_seg_fini(fd, sfd, len, idx);
+			pthread_mutex_lock(&s->mtx);
+			if (sfd < 0 && !s->err)
+				s->err = EIO;
+			continue;
+		}
+		if (s->stop)
+			break;
+		if (s->nfd < 0 && !s->err) {
+			idx = s->nidx;
+			pthread_mutex_unlock(&s->mtx);
+			sfd = fd_seg_open(fd, idx);
+			pthread_mutex_lock(&s->mtx);
+			if (sfd < 0)
+				s->err = errno;
+			s->nfd = sfd;
+			pthread_cond_broadcast(&s->cv);
+			continue;
+		}
+		pthread_cond_wait(&s->cv, &s->mtx);
+	}
+	pthread_mutex_unlock(&s->mtx);
+	return NULL;
+}
+
+/* hands the current segment over to the helper, and switches to the next one */
+static int
+fd_seg_next(struct fdpack_s *fd)
+{
+	struct fdseg_s *s = fd->f.seg;
+	int ret = 0;
+
+	pthread_mutex_lock(&s->mtx);
+	while ((s->nfd < 0 || s->qcnt == SEG_QUEUE) && !s->err)
+		pthread_cond_wait(&s->cv, &s->mtx);
+	if unlikely(s->err) {
+		errno = s->err;
+		ret = -1;
+	} else {
+		s->qfd[(s->qhead + s->qcnt) % SEG_QUEUE] = fd->fd;
+		s->qlen[(s->qhead + s->qcnt) % SEG_QUEUE] = s->pos;
+		s->qidx[(s->qhead + s->qcnt) % SEG_QUEUE] = s->idx;
+		s->qcnt++;
+		fd->fd = s->nfd;
+		s->nfd = -1;
+		s->idx = s->nidx++;
+		s->pos = 0;
+		pthread_cond_broadcast(&s->cv);
+	}
+	pthread_mutex_unlock(&s->mtx);
+	return ret;
+}
+
+static ssize_t
+fd_writev_z(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+	struct fdseg_s *s = fd->f.seg;
+	struct iovec tmp[cnt];
+	size_t len, room, done = 0, off = 0;
+	ssize_t ret;
+	int i = 0, n;
+
+	for (len = 0, n = 0; n < cnt; n++)
+		len += iov[n].iov_len;
+	/* a record that doesn't fit starts the next segment */
+	if (s->rec && s->pos && s->pos + (off_t)len > s->siz && fd_seg_next(fd) < 0)
+		return -1;
+	while (i < cnt) {
+		if (s->pos == s->siz && fd_seg_next(fd) < 0)
+			return done ? (ssize_t)done : -1;
+		room = (size_t)(s->siz - s->pos);
+		for (n = 0; i + n < cnt && room; n++) {
+			tmp[n].iov_base = (uint8_t *)iov[i + n].iov_base + (n ? 0 : off);
+			tmp[n].iov_len = Y_MIN(iov[i + n].iov_len - (n ? 0 : off), room);
+			room -= tmp[n].iov_len;
+		}
+		ret = writev(fd->fd, tmp, n);
+		if unlikely(ret < 0) {
+			if (errno == EINTR && !done)
+				continue;
+			return done ? (ssize_t)done : -1;
+		}
+		s->pos += ret;
+		done += (size_t)ret;
+		for (len = (size_t)ret; i < cnt && len >= iov[i].iov_len - off; i++) {
+			len -= iov[i].iov_len - off;
+			off = 0;
+		}
+		off += len;
+	}
+	return (ssize_t)done;
+}
+
+static ssize_t
+fd_write_z(struct fdpack_s *fd, const void *buf, size_t count)
+{
+	struct iovec iov = { (void *)buf, count };
+
+	return fd_writev_z(fd, &iov, 1);
+}
+
+static ssize_t
+fd_writem_z(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk __attribute__ ((__unused__)))
+{
+	return fd_writev_z(fd, iov, cnt);
+}
+
+static int
+fd_open_z(struct fdpack_s *fd)
+{
+	struct fdseg_s *s = fd->f.seg;
+
+	if (!fd || fd->fd != -1)
+		return -1;
+	s->idx = 0;
+	s->nidx = 1;
+	s->pos = 0;
+	s->qhead = s->qcnt = 0;
+	s->nfd = -1;
+	s->err = s->stop = 0;
+	fd->f.ppad = 0;
+	if ((fd->fd = fd_seg_open(fd, 0)) < 0)
+		return -1;
+	pthread_mutex_init(&s->mtx, NULL);
+	pthread_cond_init(&s->cv, NULL);
+	if (pthread_create(&s->thr, NULL, fd_seg_task, fd)) {
+		ERRG("pthread_create()");
+		pthread_cond_destroy(&s->cv);
+		pthread_mutex_destroy(&s->mtx);
+		TFR(close(fd->fd));
+		fd->fd = -1;
+		return -1;
+	}
+	s->started = 1;
+	return 0;
+}
+
+/*
+ * drops the strict mode pad - it's shorter than a write block, which is at
+ * most a segment, so it's either within the last segment, or it starts in the
+ * one before (complete, and closed by now) and the last one is nothing but
+ * pad; returns 1 in the latter case
+ */
+static int
+fd_seg_unpad(struct fdpack_s *fd)
+{
+	struct fdseg_s *s = fd->f.seg;
+	char name[strlen(fd->f.path) + 24];
+	off_t pad = fd->f.ppad;
+
+	fprintf(stderr, "INFO: %s: truncating the %lld byte pad\n", fd->f.path, (long long)pad);
+	if (pad < s->pos || !s->idx) {
+		s->pos -= Y_MIN(pad, s->pos);
+		return 0;
+	}
+	pad -= s->pos;
+	s->pos = 0;
+	snprintf(name, sizeof name, "%s.%05u", fd->f.path, s->idx - 1);
+	if (pad && truncate(name, s->siz - pad) < 0)
+		fprintf(stderr, "truncate(%s): %s\n", name, strerror(errno));
+	return 1;
+}
+
+static int
+fd_close_z(struct fdpack_s *fd)
+{
+	struct fdseg_s *s = fd->f.seg;
+	int ret, drop = 0;
+
+	if (fd->fd < 0 || !s->started)
+		return 0;
+	/* the helper finishes the queue first */
+	pthread_mutex_lock(&s->mtx);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->cv);
+	pthread_mutex_unlock(&s->mtx);
+	pthread_join(s->thr, NULL);
+	pthread_cond_destroy(&s->cv);
+	pthread_mutex_destroy(&s->mtx);
+	s->started = 0;
+
+	if (fd->f.psiz && fd->f.ppad)
+		drop = fd_seg_unpad(fd);
+	ret = fd_seg_fini(fd, fd->fd, s->pos, s->idx);
+	fd->fd = -1;
+	if (drop) {
+		char name[strlen(fd->f.path) + 24];
+
+		snprintf(name, sizeof name, "%s.%05u", fd->f.path, s->idx--);
+		unlink(name);
+	}
+	/* the one opened ahead is not needed */
+	if (s->nfd >= 0) {
+		char name[strlen(fd->f.path) + 24];
+
+		TFR(close(s->nfd));
+		snprintf(name, sizeof name, "%s.%05u", fd->f.path, s->nidx);
+		unlink(name);
+	}
+	if (s->err)
+		ret = -1;
+	fprintf(stderr, "INFO: %s: %u segment(s) written\n", fd->f.path, s->idx + 1);
+	return ret;
+}
+
+static void
+fd_info_z(struct fdpack_s *fd)
+{
+	fd_info_(fd);
+	fprintf(stderr,"  path:  %s.NNNNN\n  segment: %lld%s\n", fd->f.path,
+			(long long)fd->f.seg->siz, fd->f.seg->rec ? " (whole writes)" : "");
+}
+
+static int
+fd_dtor_z(struct fdpack_s *fd)
+{
+	int ret;
+
+	fd_close_z(fd);
+	ret = fd_dtor_f(fd);
+	free(fd->f.seg);
+	fd->f.seg = NULL;
+	return ret;
+}
+#endif
+
+int fd_ctor_f(struct fdpack_s* fd, int dir, const char *path, int sync, size_t dblk)
 {
 	size_t len, pathmax;
 
@@ -444,12 +1731,51 @@ int fd_ctor_f(struct fdpack_s* fd, int dir, const char *path, int sync)
 	fd->fd = -1;
 	fd->dir = dir;
 	fd->sync = sync && dir;
+	fd->f.dblk = dblk;
+	fd->f.dio = 0;
 
 	return 0;
 out:
 	return -1;
 }
 
+int fd_ctor_m(struct fdpack_s* fd, int dir, const char *path, int sync, size_t win)
+{
+#ifdef has_fmap
+	size_t page = get_page();
+
+	if (fd_ctor_f(fd, dir, path, sync, 0) < 0)
+		return -1;
+	fd->type = &_fdmap;
+	fd->f.mwin = (win + page - 1) & ~(page - 1);
+	fd->f.mptr = NULL;
+	return 0;
+#else
+	(void)fd; (void)dir; (void)path; (void)sync; (void)win;
+	return -1;
+#endif
+}
+
+int fd_ctor_z(struct fdpack_s* fd, int dir, const char *path, int sync, off_t siz, size_t rec)
+{
+#ifdef has_fseg
+	if (!dir || siz <= 0 || fd_ctor_f(fd, dir, path, sync, 0) < 0)
+		return -1;
+	if (!(fd->f.seg = calloc(1, sizeof *fd->f.seg))) {
+		ERRG("calloc()");
+		fd_dtor_f(fd);
+		return -1;
+	}
+	fd->type = &_fdseg;
+	fd->f.seg->siz = siz;
+	fd->f.seg->rec = rec;
+	return 0;
+#else
+	(void)fd; (void)dir; (void)path; (void)sync; (void)siz; (void)rec;
+	return -1;
+#endif
+}
+
 int fd_ctor_s(struct fdpack_s* fd, int dir, struct netpnt_s *np, int msgwait)
 {
 	struct sockaddr_in saddr;
@@ -30,9 +30,11 @@
 # define SOCKET_FPF "%u"
 #endif
 
+#include "common.h"
 #include "parse.h"
 
 struct fdtype_s;
+struct fdseg_s;
 struct fdpack_s;
 
 struct fdtype_s {
@@ -43,14 +45,48 @@ struct fdtype_s {
 	int (*dtor)(struct fdpack_s*);
 	ssize_t (*read)(struct fdpack_s *, void *, size_t);
 	ssize_t (*write)(struct fdpack_s *, const void *, size_t);
+	ssize_t (*readv)(struct fdpack_s *, const struct iovec *, int);
+	ssize_t (*writev)(struct fdpack_s *, const struct iovec *, int);
+	ssize_t (*readm)(struct fdpack_s *, const struct iovec *, int, size_t);
+	ssize_t (*writem)(struct fdpack_s *, const struct iovec *, int, size_t);
 };
 
 struct fdpack_s {
 	const struct fdtype_s *type;
 	int fd, dir, sync;
+	/* page cache policy window and positions (regular files only) */
+	size_t cwin;
+	off_t cpos, cmark, cprev;
 	union {
 		struct {
 			char *path;
+			/* direct i/o: requested block size, actual alignment */
+			size_t dblk, dio;
+			/*
+			 * preallocation: expected size, chunk (both as
+			 * configured); per open: allocated up to, write
+			 * position, limit (0 if none), strict mode pad
+			 * written, chunk in effect
+			 */
+			off_t psiz, pend, ppos, plim, ppad;
+			size_t pchunk, pstep;
+			/*
+			 * sparse mode: granularity (output) or just a flag
+			 * (input), position, current data / hole extents,
+			 * pending punch range, bytes elided
+			 */
+			size_t sblk;
+			off_t spos, sdat, shol, sph, spe;
+			unsigned long long int selid;
+			/*
+			 * mmap: current window (file offset, length), window
+			 * size, position, end of the input file
+			 */
+			uint8_t *mptr;
+			off_t mbase, mpos, mend;
+			size_t mlen, mwin;
+			/* segmented output: helper thread and its state */
+			struct fdseg_s *seg;
 		} f;
 		struct {
 			/*
@@ -67,6 +103,8 @@ struct fdpack_s {
 
 extern const struct fdtype_s _fdfd;
 extern const struct fdtype_s _fdfile;
+extern const struct fdtype_s _fdmap;
+extern const struct fdtype_s _fdseg;
 extern const struct fdtype_s _fdsock;
 
 #if 0
@@ -78,8 +116,98 @@ int fd_dtor(struct fdpack_s *fd);
 #endif
 
 int fd_ctor  (struct fdpack_s* fd, int dir, const char *sd, int sync);
-int fd_ctor_f(struct fdpack_s* fd, int dir, const char *path, int sync);
+int fd_ctor_f(struct fdpack_s* fd, int dir, const char *path, int sync, size_t dblk);
 int fd_ctor_s(struct fdpack_s* fd, int dir, struct netpnt_s *a, int msgwait);
+int fd_ctor_m(struct fdpack_s* fd, int dir, const char *path, int sync, size_t win);
+int fd_ctor_z(struct fdpack_s* fd, int dir, const char *path, int sync, off_t siz, size_t rec);
+
+/* underlying descriptor, for engines operating on the raw fds */
+static inline int
+fd_getfd(const struct fdpack_s *fd)
+{
+	return fd->type == &_fdsock ? (int)fd->s.fds : fd->fd;
+}
+
+/* must be called before fd_open() */
+static inline void
+fd_setcache(struct fdpack_s *fd, size_t win)
+{
+	fd->cwin = win;
+}
+
+/*
+ * output files only, must be called before fd_open(); segments are always
+ * preallocated whole, so only the size is kept (see fd_addpad())
+ */
+static inline void
+fd_setprealloc(struct fdpack_s *fd, off_t siz, size_t chunk)
+{
+#ifdef has_fseg
+	if (fd->type == &_fdseg) {
+		fd->f.psiz = siz;
+		return;
+	}
+#endif
+	if (fd->type != &_fdfile || !fd->dir)
+		return;
+	fd->f.psiz = siz;
+	fd->f.pchunk = chunk;
+}
+
+/*
+ * strict mode pad, as written after the data - with the expected size known,
+ * it's cut off at close (file or segmented output)
+ */
+static inline void
+fd_addpad(struct fdpack_s *fd, size_t n)
+{
+#ifdef has_fseg
+	if (fd->type == &_fdseg)
+		fd->f.ppad += (off_t)n;
+#endif
+	if (fd->type == &_fdfile && fd->dir)
+		fd->f.ppad += (off_t)n;
+}
+
+/*
+ * files only, must be called before fd_open(); on the input side, holes are
+ * not read, on the output side all-zero blocks of <blk> bytes are not written
+ */
+static inline void
+fd_setsparse(struct fdpack_s *fd, size_t blk)
+{
+	if (fd->type != &_fdfile)
+		return;
+	fd->f.sblk = blk;
+}
+
+/* bytes not read / written in sparse mode */
+static inline unsigned long long int
+fd_getelided(const struct fdpack_s *fd)
+{
+	return fd->type == &_fdfile ? fd->f.selid : 0;
+}
+
+/* direct i/o alignment, 0 if not in effect */
+static inline size_t
+fd_getdio(const struct fdpack_s *fd)
+{
+	return fd->type == &_fdfile ? fd->f.dio : 0;
+}
+
+int fd_nodirect(struct fdpack_s *fd);
+
+/*
+ * mmap input: map the data at the current position, returns its length (no
+ * more than <max>), 0 at the end of file; fd_map_skip() consumes it
+ */
+ssize_t fd_map_peek(struct fdpack_s *fd, const void **ptr, size_t max);
+
+static inline void
+fd_map_skip(struct fdpack_s *fd, size_t cnt)
+{
+	fd->f.mpos += (off_t)cnt;
+}
 
 /*
  * virtuals
@@ -103,6 +231,35 @@ fd_write(struct fdpack_s *fd, const void *buf, size_t count)
 	return fd->type->write(fd, buf, count);
 }
 
+static inline ssize_t
+fd_readv(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+	return fd->type->readv(fd, iov, cnt);
+}
+
+static inline ssize_t
+fd_writev(struct fdpack_s *fd, const struct iovec *iov, int cnt)
+{
+	return fd->type->writev(fd, iov, cnt);
+}
+
+/*
+ * batched (multi block) variants - iovecs describe several blocks of size
+ * blk; for stream-like fds it's equivalent to readv() / writev(), for
+ * datagram sockets each block is a separate datagram
+ */
+static inline ssize_t
+fd_readm(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk)
+{
+	return fd->type->readm(fd, iov, cnt, blk);
+}
+
+static inline ssize_t
+fd_writem(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk)
+{
+	return fd->type->writem(fd, iov, cnt, blk);
+}
+
 static inline int
 fd_open(struct fdpack_s *fd)
 {
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __ftxw_h__
+#define __ftxw_h__
+
+# if defined(has_ftx_linux)
+#  include "ftxw_linux.h"
+
+int ftxw_dt(struct ftx_s *);
+
+int ftxw_dtor(struct ftx_s *);
+int ftxw_ctor(struct ftx_s *, const char *, int);
+
+void ftxw_sleep(struct ftx_s *, uint32_t);
+void ftxw_report(const struct ftx_s *, const char *);
+
+# endif /* futexes */
+
+#endif /* header */
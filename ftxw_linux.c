@@ -0,0 +1,97 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#ifdef has_ftx_linux
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "common.h"
+#include "ftxw.h"
+
+static inline long int
+sys_futex(uint32_t *addr, int op, uint32_t val)
+{
+	return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+int ftxw_dt(struct ftx_s *f)
+{
+	if (!f)
+		return -1;
+	return 0;
+}
+
+int ftxw_dtor(struct ftx_s *f)
+{
+	if (ftxw_dt(f) < 0)
+		return -1;
+	f->name = NULL;
+	return 0;
+}
+
+/* mp (process shared) futexes can't use private ops */
+int ftxw_ctor(struct ftx_s *f, const char *name, int mp)
+{
+	if (!f || !name)
+		return -1;
+	memset(f, 0, sizeof *f);
+	f->op = mp ? 0 : FUTEX_PRIVATE_FLAG;
+	f->name = name;
+	return 0;
+}
+
+/*
+ * seq must be the value returned by ftxw_prep(); if the waker bumped it in the
+ * meantime, the kernel returns immediately with EAGAIN; EINTR (e.g. our
+ * SIGUSR1 pings) is fine as well - the caller re-checks everything anyway
+ */
+void ftxw_sleep(struct ftx_s *f, uint32_t seq)
+{
+	f->slept++;
+	if (sys_futex(&f->seq, FUTEX_WAIT | f->op, seq) < 0 && errno != EAGAIN && errno != EINTR)
+		ERRG("futex(FUTEX_WAIT)");
+}
+
+/* unconditional wakeup - also used on termination */
+void ftxw_kick(struct ftx_s *f)
+{
+	__atomic_add_fetch(&f->seq, 1, __ATOMIC_RELEASE);
+	if (sys_futex(&f->seq, FUTEX_WAKE | f->op, INT_MAX) < 0)
+		ERRG("futex(FUTEX_WAKE)");
+}
+
+void ftxw_report(const struct ftx_s *f, const char *tag)
+{
+	fprintf (stderr,
+		"  %s waits: %llu resolved by spinning, %llu slept\n",
+		tag, f->spun, f->slept
+	);
+}
+
+#else
+	/* mostly to quiet gcc */
+	int has_no_linux_futexes = 1;
+#endif
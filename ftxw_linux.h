@@ -0,0 +1,66 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __ftxw_linux_h__
+#define __ftxw_linux_h__
+
+#include <stdint.h>
+#include "common.h"
+
+/*
+ * seq is the futex word - bumped by the waking side; wait is set by the
+ * sleeping side before its final check of the condition, so the waking side
+ * can skip the syscall if nobody is interested; spun / slept count waits
+ * resolved within the spin window and actual sleeps
+ */
+struct ftx_s {
+	uint32_t seq;
+	int wait, op;
+	unsigned long long int spun, slept;
+	const char *name;
+};
+
+void ftxw_kick(struct ftx_s *);
+
+/* sleeper: announce the wait; must be followed by re-check of the condition */
+static inline uint32_t
+ftxw_prep(struct ftx_s *f)
+{
+	uint32_t seq = load_acq(f->seq);
+	store_rlx(f->wait, 1);
+	full_barrier();
+	return seq;
+}
+
+/* sleeper: condition satisfied */
+static inline void
+ftxw_done(struct ftx_s *f)
+{
+	store_rlx(f->wait, 0);
+}
+
+/* waker: must be called after the new cursor is published */
+static inline void
+ftxw_wake(struct ftx_s *f)
+{
+	full_barrier();
+	if unlikely(load_rlx(f->wait))
+		ftxw_kick(f);
+}
+
+#endif
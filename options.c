@@ -29,18 +29,53 @@
 
 #include "version.h"
 #include "common.h"
+#include "digest.h"
 #include "options.h"
+#include "parity.h"
 #include "parse.h"
 
 #define DEF_MAXCNT 1048576u
 #define DEF_MAXBLK 4194304u
 #define DEF_MAXHPAGE (256u*1048576u)
+#define DEF_MAXSPIN 1000000000u
+#define DEF_MAXQDEP 4096u
+#define DEF_MAXRPAR 64u
+#define DEF_MAXWPAR 64u
 
 
+static const char *engines[] = {
+	[eng_ring] = "ring",
+#ifdef has_splice
+	[eng_splice] = "splice",
+#endif
+#ifdef has_offload
+	[eng_offload] = "offload",
+#endif
+#ifdef has_uring_linux
+	[eng_uring] = "uring",
+#endif
+};
+
+const char *opt_engine(enum engine_t e)
+{
+	return engines[e];
+}
+
+static int get_engine(const char *s)
+{
+	unsigned int i;
+	for (i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+		if (engines[i] && !strcasecmp(s, engines[i]))
+			return (int)i;
+	}
+	return -1;
+}
+
 static void unset_in(struct options_s *opts)
 {
 	opts->fd[0] = NULL;
 	opts->file[0] = NULL;
+	opts->map[0] = NULL;
 	opts->sock[0].dom = 0;
 }
 
@@ -48,6 +83,7 @@ static void unset_out(struct options_s *opts)
 {
 	opts->fd[1] = NULL;
 	opts->file[1] = NULL;
+	opts->map[1] = NULL;
 	opts->sock[1].dom = 0;
 }
 
@@ -60,6 +96,8 @@ static void set_default(struct options_s *opts)
 	opts->wblk = 65536;
 	opts->rcnt = 1;
 	opts->wcnt = 1;
+	opts->mwin = 16777216;
+	opts->qdep = 8;
 	opts->cpuR = -1;
 	opts->cpuW = -1;
 #ifdef h_mingw
@@ -82,11 +120,14 @@ static void help(void)
 		"	-b <size>	reader's blocking unit\n"
 		"	-B <size>	writer's blocking unit\n"
 		"	-m <size>	buffer size\n"
-		"	-n <size>	try to read at least <n> blocks (n/a if MP)\n"
-		"	-N <size>	try to write at least <n> blocks (n/a if MP)\n"
+		"	-n <size>	try to read at least <n> blocks (n/a if MP, unless -a)\n"
+		"	-N <size>	try to write at least <n> blocks (n/a if MP, unless -A)\n"
 		"	-H <size>	request huge pages of size <n> (linux only)\n"
 		"	-p <float>	resume point after overrun (reader)\n"
 		"	-P <float>	resume point after underrun (writer)\n"
+#ifdef has_ftx_linux
+		"	-w <ns>	futex waits, spin up to <ns> before sleeping (n/a if SP)\n"
+#endif
 #ifdef h_affi
 		"	-u <cpu>	try to run reader only on <cpu>\n"
 		"	-U <cpu>	try to run writer only on <cpu>\n"
@@ -98,20 +139,87 @@ static void help(void)
 		"	-1	use single process\n"
 #endif
 		"	-y	fsync output after the transfer\n"
+#ifdef h_thr
+		"	-Y <size>	make the output durable every <size> bytes, during the transfer\n"
+		"	-j <n>[:<skip>[:<count>]]	read a file / block device with <n> parallel readers,\n"
+		"		optionally <count> bytes only, starting <skip> bytes in\n"
+		"	-J <n>	write a file / block device with <n> parallel writers\n"
+		"	-T	stripe the stream over repeated -o (or read it back from repeated -i),\n"
+		"		in units of the block size of the side\n"
+		"	-R <n>	add <n> (1 - xor, 2 - reed-solomon) parity members, the last -o\n"
+		"		outputs of the stripe set; reading back can rebuild up to <n> missing\n"
+		"		members, or verify the parity if none is missing\n"
+#endif
 		"	-r	strict blocking writes\n"
+		"	-e <name>	transfer engine (ring"
+#ifdef has_splice
+		", splice"
+#endif
+#ifdef has_offload
+		", offload"
+#endif
+#ifdef has_uring_linux
+		", uring"
+#endif
+		")\n"
+#ifdef has_uring_linux
+		"	-q <n>	uring engine: reads and writes in flight (each)\n"
+		"	-Q	uring engine: kernel side submission polling\n"
+#endif
+		"	-a	batched reads, up to <n> (-n) blocks per call\n"
+		"	-A	batched writes, up to <n> (-N) blocks per call\n"
+#ifdef has_splice
+		"	-G	gift buffer pages to the output pipe (vmsplice)\n"
+#endif
+#ifdef has_fcache
+		"	-f <size>	readahead window (regular file input)\n"
+		"	-F <size>	write-behind window (regular file output)\n"
+#endif
+#ifdef has_falloc
+		"	-z <size>	expected size, for preallocation of file output\n"
+		"	-k <size>	preallocate file output in chunks ahead of the writer\n"
+#endif
+#ifdef has_fmap
+		"	-M <size>	mmap window (m: endpoints)\n"
+#endif
+#ifdef has_fseg
+		"	-Z <size>[:r]	split file output into <path>.NNNNN segments of <size>\n"
+		"		(:r - cut at write boundaries, never inside a write)\n"
+#endif
+#ifdef has_sparse
+		"	-s	sparse file input (holes are not read)\n"
+		"	-S	sparse file output (zero blocks are not written)\n"
+#endif
+#ifdef has_dio
+		"	-d	direct i/o for file input\n"
+		"	-D	direct i/o for file output\n"
+#endif
 		"	-l	reader in byte/line mode\n"
 		"	-L	writer in byte/line mode\n"
 		"	-g	enable builtin looping until error/interruption\n"
 		"	-c	calculate crc & cksum (reader)\n"
 		"	-C	calculate crc & cksum (writer)\n"
+#ifdef h_thr
+		"	-E <n>	take the reader's crc (-c) in a separate task, with <n> threads\n"
+#else
+		"	-E 1	take the reader's crc (-c) in a separate task\n"
+#endif
+		"	-x <d>	digest for -c / -C: crc32 (default, cksum), crc32c, xxh64, blake3\n"
 		"	-h	help + known socket options\n"
 		"\n"
+#ifdef has_fmap
+		"- <spec> is ([fdtum]:|:|)<string> (case insensitive), eg:\n"
+#else
 		"- <spec> is ([fdtu]:|:|)<string> (case insensitive), eg:\n"
+#endif
 		"	t:host.tld:12345:SO_SNDBUF=67890,TCP_NODELAY,IPTOS=1|2|IPTOS_LOWDELAY\n"
 		"	u:host.tld:12345:SO_SNDBUF=1472\n"
 		"	d:123\n"
 		"	-\n"
 		"	f:/stuff/backup.tar\n"
+#ifdef has_fmap
+		"	m:/stuff/backup.tar (regular file, through mmap windows)\n"
+#endif
 		"	'd' and 'f:' can usually be omitted; '-' substitutes for d:0 or d:1\n"
 		"- <size> is an integer, which can be suffixed with [bBkKmMgG]\n"
 		"- <cpu> is a required cpu number, starting with 0\n"
@@ -146,6 +254,11 @@ opt_subparse(struct options_s *opts, const char *spec, int dir)
 			spec++;
 		opts->fd[dir] = spec;
 		ret = 0;
+#ifdef has_fmap
+	} else if (len > 2 && !strncasecmp(spec, "m:", 2)) {
+		opts->map[dir] = spec + 2;
+		ret = 0;
+#endif
 	} else if (!strcasecmp(spec, "-")) {
 		opts->fd[dir] = dash[dir];
 		ret = 0;
@@ -159,16 +272,29 @@ opt_subparse(struct options_s *opts, const char *spec, int dir)
 	return ret;
 }
 
+/* a single member of a stripe set, replacing the side's endpoint in <opts> */
+int opt_spec(struct options_s *opts, const char *spec, int dir)
+{
+	if (dir)
+		unset_out(opts);
+	else
+		unset_in(opts);
+	return opt_subparse(opts, spec, dir);
+}
+
 int opt_parse(struct options_s *opts, int argc, char **argv)
 {
 	static const char err_inv[] = "Invalid -%c value.\n";
 	double rs = 0, ws = 0;
-	int opt;
+#if defined(h_thr) || defined(has_fseg)
+	const char *ptr;
+#endif
+	int opt, eng;
 
 	set_default(opts);
 
 	opterr = 0;
-	while ((opt = getopt(argc, argv, "i:o:b:B:m:n:N:H:r1ytlLcCghp:P:u:U:")) != -1) {
+	while ((opt = getopt(argc, argv, "i:o:b:B:m:n:N:H:r1ytlLcCghp:P:u:U:w:aAe:Gq:QdDf:F:Y:z:k:sSM:j:J:TR:Z:E:x:")) != -1) {
 		switch (opt) {
 			case 'n':
 				opts->rcnt = (size_t)get_ul(optarg);
@@ -190,6 +316,9 @@ int opt_parse(struct options_s *opts, int argc, char **argv)
 					fprintf (stderr, "Bad input file descriptor specification.\n");
 					goto out;
 				}
+				if (opts->nmem[0] < STRIPE_MAX)
+					opts->smem[0][opts->nmem[0]] = optarg;
+				opts->nmem[0]++;
 				break;
 			case 'o':
 				unset_out(opts);
@@ -197,6 +326,9 @@ int opt_parse(struct options_s *opts, int argc, char **argv)
 					fprintf (stderr, "Bad output file descriptor specification.\n");
 					goto out;
 				}
+				if (opts->nmem[1] < STRIPE_MAX)
+					opts->smem[1][opts->nmem[1]] = optarg;
+				opts->nmem[1]++;
 				break;
 			case 'b':
 				opts->rblk = (size_t)get_ul(optarg);
@@ -242,6 +374,16 @@ int opt_parse(struct options_s *opts, int argc, char **argv)
 				}
 				opts->wsp = ws;
 				break;
+#ifdef has_ftx_linux
+			case 'w':
+				opts->spin = (size_t)get_ul(optarg);
+				if (errno || opts->spin > DEF_MAXSPIN) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				opts->ftx = 1;
+				break;
+#endif
 #ifdef h_affi
 			case 'u':
 				opts->cpuR = (int)get_ul(optarg);
@@ -277,6 +419,151 @@ int opt_parse(struct options_s *opts, int argc, char **argv)
 			case 'r':
 				opts->strict = 1;
 				break;
+			case 'e':
+				if ((eng = get_engine(optarg)) < 0) {
+					fprintf(stderr, "Unknown engine: %s\n", optarg);
+					goto out;
+				}
+				opts->engine = (enum engine_t)eng;
+				break;
+			case 'a':
+				opts->rbat = 1;
+				break;
+			case 'A':
+				opts->wbat = 1;
+				break;
+#ifdef has_uring_linux
+			case 'q':
+				opts->qdep = (size_t)get_ul(optarg);
+				if (errno || opts->qdep < 1 || opts->qdep > DEF_MAXQDEP) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+			case 'Q':
+				opts->sqpoll = 1;
+				break;
+#endif
+#ifdef has_splice
+			case 'G':
+				opts->gift = 1;
+				break;
+#endif
+#ifdef h_thr
+			case 'j':
+				opts->rpar = (size_t)get_ul(optarg);
+				if (errno || !opts->rpar || opts->rpar > DEF_MAXRPAR) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				if ((ptr = strchr(optarg, ':'))) {
+					opts->rskip = (size_t)get_ul(++ptr);
+					if (!errno && (ptr = strchr(ptr, ':')))
+						opts->rcount = (size_t)get_ul(++ptr);
+					if (errno) {
+						fprintf(stderr, err_inv, opt);
+						goto out;
+					}
+				}
+				break;
+			case 'T':
+				opts->stripe = 1;
+				break;
+			case 'R':
+				opts->npty = (size_t)get_ul(optarg);
+				if (errno || !opts->npty || opts->npty > PTY_MAX) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+			case 'J':
+				opts->wpar = (size_t)get_ul(optarg);
+				if (errno || !opts->wpar || opts->wpar > DEF_MAXWPAR) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+			case 'Y':
+				opts->dint = (size_t)get_ul(optarg);
+				if (errno || !opts->dint) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+#endif
+#ifdef has_fseg
+			case 'Z':
+				opts->zsiz = (size_t)get_ul(optarg);
+				if (errno || !opts->zsiz) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				if ((ptr = strchr(optarg, ':'))) {
+					if (strcmp(++ptr, "r")) {
+						fprintf(stderr, err_inv, opt);
+						goto out;
+					}
+					opts->zrec = 1;
+				}
+				break;
+#endif
+#ifdef has_fcache
+			case 'f':
+				opts->rcache = (size_t)get_ul(optarg);
+				if (errno) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+			case 'F':
+				opts->wcache = (size_t)get_ul(optarg);
+				if (errno) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+#endif
+#ifdef has_falloc
+			case 'z':
+				opts->psiz = (size_t)get_ul(optarg);
+				if (errno) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+			case 'k':
+				opts->pchunk = (size_t)get_ul(optarg);
+				if (errno) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+#endif
+#ifdef has_fmap
+			case 'M':
+				opts->mwin = (size_t)get_ul(optarg);
+				if (errno || !opts->mwin) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+#endif
+#ifdef has_sparse
+			case 's':
+				opts->rsparse = 1;
+				break;
+			case 'S':
+				opts->wsparse = 1;
+				break;
+#endif
+#ifdef has_dio
+			case 'd':
+				opts->rdio = 1;
+				break;
+			case 'D':
+				opts->wdio = 1;
+				break;
+#endif
 			case 'l':
 				opts->rline = 1;
 				break;
@@ -289,6 +576,19 @@ int opt_parse(struct options_s *opts, int argc, char **argv)
 			case 'C':
 				opts->wcrc = 1;
 				break;
+			case 'E':
+				opts->crct = (size_t)get_ul(optarg);
+				if (errno || !opts->crct || opts->crct > CRCT_MAX) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
+			case 'x':
+				if ((opts->dgst = dg_type(optarg)) < 0) {
+					fprintf(stderr, err_inv, opt);
+					goto out;
+				}
+				break;
 			case 'h':
 				help();
 				goto out;
@@ -297,10 +597,122 @@ int opt_parse(struct options_s *opts, int argc, char **argv)
 				goto out;
 		}
 	}
+	if (opts->engine != eng_ring && opts->mode != sp) {
+		fprintf(stderr, "Engine '%s' implies single process mode.\n", engines[opts->engine]);
+		opts->mode = sp;
+	}
 	if (opts->wline && opts->strict) {
 		fputs("Strict mode makes no sense with writer in line mode.\n", stderr);
 		goto out;
 	}
+	/*
+	 * mmap input with nothing to do on the way - the writer can use the
+	 * mapping directly, which requires both sides in one process
+	 */
+	if (opts->map[0] && opts->engine == eng_ring && opts->rblk == opts->wblk &&
+	    !opts->strict && !opts->rcrc && !opts->wcrc && !opts->gift && !opts->rline && !opts->wline && !opts->rpar && !opts->wpar && !opts->stripe) {
+		if (opts->mode != sp)
+			fputs("Zero copy mmap input implies single process mode.\n", stderr);
+		opts->mode = sp;
+		opts->mapzc = 1;
+	}
+	if (opts->stripe) {
+		if (opts->nmem[0] > STRIPE_MAX || opts->nmem[1] > STRIPE_MAX) {
+			fprintf(stderr, "At most %d stripe members are supported.\n", STRIPE_MAX);
+			goto out;
+		}
+		if (opts->nmem[0] < 2 && opts->nmem[1] < 2) {
+			fputs("Striping needs at least 2 inputs or outputs.\n", stderr);
+			goto out;
+		}
+		if (opts->engine != eng_ring ||
+		    (opts->nmem[0] > 1 && (opts->rpar || opts->rline || opts->rsparse || opts->rdio)) ||
+		    (opts->nmem[1] > 1 && (opts->wpar || opts->wline || opts->wsparse || opts->gift || opts->wdio))) {
+			fputs("Striping requires the ring engine, and no parallel, byte, gift, sparse or direct i/o mode on the striped side.\n", stderr);
+			goto out;
+		}
+		if (opts->mode == sp) {
+			fputs("Striping implies multi-thread mode.\n", stderr);
+			opts->mode = mt;
+		}
+	}
+	if (opts->npty) {
+		if (!opts->stripe || opts->nmem[1] < opts->npty + 2) {
+			fputs("Parity needs a stripe set (-T) of at least 2 data outputs on top of the parity ones.\n", stderr);
+			goto out;
+		}
+		if (opts->strict) {
+			fputs("Parity can't be used with strict mode.\n", stderr);
+			goto out;
+		}
+	}
+	if (opts->rpar) {
+		if (opts->engine != eng_ring || opts->rline) {
+			fputs("Parallel readers require the ring engine, and no byte mode.\n", stderr);
+			goto out;
+		}
+		if (opts->mode == sp) {
+			fputs("Parallel readers imply multi-thread mode.\n", stderr);
+			opts->mode = mt;
+		}
+	}
+	if (opts->wpar) {
+		if (opts->engine != eng_ring || opts->wline || opts->gift || opts->wsparse) {
+			fputs("Parallel writers require the ring engine, and no byte, gift or sparse mode.\n", stderr);
+			goto out;
+		}
+		if (opts->mode == sp) {
+			fputs("Parallel writers imply multi-thread mode.\n", stderr);
+			opts->mode = mt;
+		}
+	}
+	if (opts->zsiz) {
+		if (!opts->file[1] || opts->engine != eng_ring || opts->stripe || opts->wpar ||
+		    opts->wline || opts->wsparse || opts->gift || opts->wdio) {
+			fputs("Segmented output requires a file output, the ring engine, and no striping, parallel, byte, gift, sparse or direct i/o mode.\n", stderr);
+			goto out;
+		}
+		if (opts->wblk > opts->zsiz) {
+			fputs("Segment size must be at least the write block size.\n", stderr);
+			goto out;
+		}
+	}
+	if (opts->crct) {
+		if (!opts->rcrc || opts->engine != eng_ring || opts->rpar || opts->nmem[0] > 1) {
+			fputs("Checksum task requires reader's crc (-c), the ring engine, and no parallel or striped input.\n", stderr);
+			goto out;
+		}
+#ifndef h_thr
+		if (opts->crct > 1) {
+			fputs("Checksum threads (-E <n> with n > 1) are not supported on this platform.\n", stderr);
+			goto out;
+		}
+#endif
+		if (opts->crct > 1 && opts->dgst != DG_CRC32) {
+			fputs("Checksum threads (-E <n> with n > 1) require the crc32 digest.\n", stderr);
+			goto out;
+		}
+		if (opts->mode == sp) {
+#if defined(h_thr)
+			fputs("Checksum task implies multi-thread mode.\n", stderr);
+			opts->mode = mt;
+#elif !defined(h_mingw)
+			fputs("Checksum task implies multi-process mode.\n", stderr);
+			opts->mode = mp;
+#else
+			fputs("Checksum task is not supported on this platform.\n", stderr);
+			goto out;
+#endif
+		}
+	}
+	if ((opts->rsparse || opts->wsparse) && opts->engine != eng_ring) {
+		fputs("Sparse mode requires the ring engine.\n", stderr);
+		goto out;
+	}
+	if ((opts->rline && opts->rdio) || (opts->wline && opts->wdio)) {
+		fputs("Direct i/o makes no sense in line mode.\n", stderr);
+		goto out;
+	}
 
 #if 0
 	if (opts->rblk < opts->wblk && opts->rline && !opts->wline) {
@@ -21,21 +21,36 @@
 
 #include "parse.h"
 
+/* max. members of a stripe set (-T) */
+#define STRIPE_MAX 16
+/* max. threads of the checksum task (-E) */
+#define CRCT_MAX 64
+
 enum mode_t {mp = 1, mt, sp};
+enum engine_t {eng_ring = 0, eng_splice, eng_offload, eng_uring};
 
 struct options_s {
 	const char *fd[2];
 	const char *file[2];
+	const char *map[2];
+	/* all -i / -o specs, in order - the members of striped sides */
+	const char *smem[2][STRIPE_MAX];
+	size_t nmem[2];
 	struct netpnt_s sock[2];
 	size_t bsiz;
 	size_t rblk, rcnt;
 	size_t wblk, wcnt;
 	double rsp, wsp;
-	size_t hpage;
-	int fsync, strict, rline, wline, rcrc, wcrc, loop, cpuR, cpuW;
+	size_t hpage, spin, qdep, rcache, wcache, dint, psiz, pchunk, mwin;
+	size_t rpar, rskip, rcount, wpar, npty, zsiz, crct;
+	int fsync, strict, rline, wline, rcrc, wcrc, loop, cpuR, cpuW, ftx;
+	int rbat, wbat, gift, sqpoll, rdio, wdio, rsparse, wsparse, mapzc, stripe, zrec, dgst;
 	enum mode_t mode;
+	enum engine_t engine;
 };
 
 int  opt_parse(struct options_s*, int argc, char **argv);
+int  opt_spec(struct options_s*, const char *spec, int dir);
+const char *opt_engine(enum engine_t);
 
 #endif
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#include <string.h>
+#include "parity.h"
+
+/*
+ * parity for striped sets - P is the plain xor of the data units, Q is the
+ * raid-6 style reed-solomon syndrome over GF(2^8) with the generator {02} and
+ * the polynomial 0x11d: Q = sum(g^i * D_i)
+ *
+ * the bulk kernels (xor, multiplication by {02}) work on 64 bit words, 64
+ * bytes per iteration, which the compiler turns into vector code; general
+ * multiplication goes through the log tables and is used only when
+ * rebuilding missing members
+ */
+
+typedef uint64_t __attribute__ ((__may_alias__)) word_t;
+
+static uint8_t gexp[512];
+static uint8_t glog[256];
+
+void pty_init(void)
+{
+	unsigned int i, v = 1;
+
+	for (i = 0; i < 255; i++) {
+		gexp[i] = gexp[i + 255] = (uint8_t)v;
+		glog[v] = (uint8_t)i;
+		v <<= 1;
+		if (v & 0x100)
+			v ^= 0x11d;
+	}
+	gexp[510] = gexp[0];
+	glog[0] = 0;
+}
+
+uint8_t pty_gmul(uint8_t a, uint8_t b)
+{
+	if (!a || !b)
+		return 0;
+	return gexp[glog[a] + glog[b]];
+}
+
+uint8_t pty_gpow(int e)
+{
+	return gexp[(unsigned int)(e % 255 + 255) % 255];
+}
+
+uint8_t pty_ginv(uint8_t a)
+{
+	return a ? gexp[255 - glog[a]] : 0;
+}
+
+void pty_xor(uint8_t *restrict dst, const uint8_t *restrict src, size_t len)
+{
+	word_t *d;
+	const word_t *s;
+	int i;
+
+	for (; len && ((uintptr_t)dst & 7); len--)
+		*dst++ ^= *src++;
+	d = (word_t *)dst;
+	s = (const word_t *)src;
+	for (; len >= 64; len -= 64, d += 8, s += 8) {
+		for (i = 0; i < 8; i++)
+			d[i] ^= s[i];
+	}
+	for (; len >= 8; len -= 8)
+		*d++ ^= *s++;
+	dst = (uint8_t *)d;
+	src = (const uint8_t *)s;
+	while (len--)
+		*dst++ ^= *src++;
+}
+
+/* multiplication by {02} of all bytes in the word at once */
+static inline uint64_t mul2w(uint64_t v)
+{
+	uint64_t hi = v & 0x8080808080808080ull;
+
+	return ((v << 1) & 0xfefefefefefefefeull) ^ ((hi - (hi >> 7)) & 0x1d1d1d1d1d1d1d1dull);
+}
+
+static inline uint8_t mul2b(uint8_t v)
+{
+	return (uint8_t)((v << 1) ^ (v & 0x80 ? 0x1d : 0));
+}
+
+void pty_mul2(uint8_t *dst, size_t len)
+{
+	word_t *d;
+	int i;
+
+	for (; len && ((uintptr_t)dst & 7); len--, dst++)
+		*dst = mul2b(*dst);
+	d = (word_t *)dst;
+	for (; len >= 64; len -= 64, d += 8) {
+		for (i = 0; i < 8; i++)
+			d[i] = mul2w(d[i]);
+	}
+	for (; len >= 8; len -= 8, d++)
+		*d = mul2w(*d);
+	for (dst = (uint8_t *)d; len; len--, dst++)
+		*dst = mul2b(*dst);
+}
+
+/* dst ^= c * src */
+void pty_mul(uint8_t *restrict dst, const uint8_t *restrict src, uint8_t c, size_t len)
+{
+	const uint8_t *e;
+	size_t i;
+
+	if (!c)
+		return;
+	if (c == 1) {
+		pty_xor(dst, src, len);
+		return;
+	}
+	e = gexp + glog[c];
+	for (i = 0; i < len; i++) {
+		if (src[i])
+			dst[i] ^= e[glog[src[i]]];
+	}
+}
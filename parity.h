@@ -0,0 +1,36 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __parity_h__
+#define __parity_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* max. parity members of a stripe set (-R) - P (xor) and Q (reed-solomon) */
+#define PTY_MAX 2
+
+void pty_init(void);
+void pty_xor(uint8_t *restrict dst, const uint8_t *restrict src, size_t len);
+void pty_mul2(uint8_t *dst, size_t len);
+void pty_mul(uint8_t *restrict dst, const uint8_t *restrict src, uint8_t c, size_t len);
+uint8_t pty_gmul(uint8_t a, uint8_t b);
+uint8_t pty_gpow(int e);
+uint8_t pty_ginv(uint8_t a);
+
+#endif
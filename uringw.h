@@ -0,0 +1,33 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __uringw_h__
+#define __uringw_h__
+
+# if defined(has_uring_linux)
+#  include "uringw_linux.h"
+
+int uringw_dtor(struct uring_s *);
+int uringw_ctor(struct uring_s *, unsigned int, int);
+
+int uringw_reg(struct uring_s *, void *, size_t);
+int uringw_enter(struct uring_s *, unsigned int);
+
+# endif /* io_uring */
+
+#endif /* header */
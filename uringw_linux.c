@@ -0,0 +1,188 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#ifdef has_uring_linux
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+#include "uringw.h"
+
+static inline int
+sys_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int
+sys_enter(int fd, unsigned int sub, unsigned int min, unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, sub, min, flags, NULL, 0);
+}
+
+static inline int
+sys_register(int fd, unsigned int op, void *arg, unsigned int nr)
+{
+	return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+int uringw_dtor(struct uring_s *u)
+{
+	if (!u)
+		return -1;
+	if (u->sqes)
+		munmap(u->sqes, u->qlen);
+	if (u->cptr && u->cptr != u->sptr)
+		munmap(u->cptr, u->clen);
+	if (u->sptr)
+		munmap(u->sptr, u->slen);
+	if (u->fd >= 0)
+		close(u->fd);
+	memset(u, 0, sizeof *u);
+	u->fd = -1;
+	return 0;
+}
+
+/*
+ * returns -1 if io_uring is not available (ENOSYS, disabled by sysctl, not
+ * permitted, ...) or lacks what we need - the caller is expected to fall
+ * back to something else; offset -1 (current file position) support is
+ * required for non seekable fds
+ */
+int uringw_ctor(struct uring_s *u, unsigned int depth, int sqpoll)
+{
+	struct io_uring_params p;
+
+	if (!u || !depth)
+		return -1;
+	memset(u, 0, sizeof *u);
+	memset(&p, 0, sizeof p);
+	if (sqpoll) {
+		p.flags = IORING_SETUP_SQPOLL;
+		p.sq_thread_idle = 1000;
+	}
+	if ((u->fd = sys_setup(depth, &p)) < 0) {
+		perror("io_uring_setup()");
+		u->fd = -1;
+		return -1;
+	}
+	if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+		fputs("uring: kernel is too old (no IORING_FEAT_RW_CUR_POS)\n", stderr);
+		goto out;
+	}
+	u->sqpoll = sqpoll;
+	u->depth = p.sq_entries;
+
+	u->slen = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	u->clen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		u->slen = u->clen = Y_MAX(u->slen, u->clen);
+	u->sptr = mmap(NULL, u->slen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sptr == MAP_FAILED) {
+		u->sptr = NULL;
+		perror("mmap(sq)");
+		goto out;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		u->cptr = u->sptr;
+	else {
+		u->cptr = mmap(NULL, u->clen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if (u->cptr == MAP_FAILED) {
+			u->cptr = NULL;
+			perror("mmap(cq)");
+			goto out;
+		}
+	}
+	u->qlen = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->qlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		u->sqes = NULL;
+		perror("mmap(sqes)");
+		goto out;
+	}
+
+	u->shead  = (unsigned int *)((uint8_t *)u->sptr + p.sq_off.head);
+	u->stailk = (unsigned int *)((uint8_t *)u->sptr + p.sq_off.tail);
+	u->smask  = (unsigned int *)((uint8_t *)u->sptr + p.sq_off.ring_mask);
+	u->sflags = (unsigned int *)((uint8_t *)u->sptr + p.sq_off.flags);
+	u->sarr   = (unsigned int *)((uint8_t *)u->sptr + p.sq_off.array);
+	u->chead  = (unsigned int *)((uint8_t *)u->cptr + p.cq_off.head);
+	u->ctail  = (unsigned int *)((uint8_t *)u->cptr + p.cq_off.tail);
+	u->cmask  = (unsigned int *)((uint8_t *)u->cptr + p.cq_off.ring_mask);
+	u->cqes   = (struct io_uring_cqe *)((uint8_t *)u->cptr + p.cq_off.cqes);
+	u->stail  = *u->stailk;
+	return 0;
+out:
+	uringw_dtor(u);
+	return -1;
+}
+
+/*
+ * register [ptr, ptr+len) as fixed buffer 0; failure is not fatal - e.g. some
+ * kernels refuse shared file backed memory - we just keep using regular ops
+ */
+int uringw_reg(struct uring_s *u, void *ptr, size_t len)
+{
+	struct iovec iov = { .iov_base = ptr, .iov_len = len };
+
+	if (sys_register(u->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+		return -1;
+	u->fixed = 1;
+	return 0;
+}
+
+/*
+ * publish pending sqes and optionally wait for at least one completion; with
+ * sqpoll, the syscall is needed only to wake up the idle kernel thread, or if
+ * we have to wait
+ */
+int uringw_enter(struct uring_s *u, unsigned int wait)
+{
+	unsigned int flags = 0, sub = u->spend;
+	int ret;
+
+	store_rel(*u->stailk, u->stail);
+	u->spend = 0;
+	if (u->sqpoll) {
+		full_barrier();
+		if (load_rlx(*u->sflags) & IORING_SQ_NEED_WAKEUP)
+			flags |= IORING_ENTER_SQ_WAKEUP;
+		sub = 0;
+	}
+	if (wait)
+		flags |= IORING_ENTER_GETEVENTS;
+	if (!flags && !sub)
+		return 0;
+	do {
+		ret = sys_enter(u->fd, sub, wait ? 1 : 0, flags);
+	} while (ret < 0 && errno == EAGAIN);
+	return ret;
+}
+
+#else
+	/* mostly to quiet gcc */
+	int has_no_linux_uring = 1;
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2012+ Michal Soltys <soltys@ziu.info>
+ *
+ * This file is part of Yancat.
+ *
+ * Yancat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Yancat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Yancat. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __uringw_linux_h__
+#define __uringw_linux_h__
+
+#include <stdint.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include "common.h"
+
+/*
+ * minimal io_uring wrapper - raw syscalls, no liburing; the kernel side
+ * pointers of both rings are mapped directly; stail is our local copy of the
+ * submission tail, published in uringw_enter(); fixed is set if a buffer was
+ * registered with uringw_reg() (buffer index 0)
+ */
+struct uring_s {
+	int fd, fixed, sqpoll;
+	unsigned int depth, stail, spend;
+	unsigned int *shead, *stailk, *smask, *sflags, *sarr;
+	unsigned int *chead, *ctail, *cmask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sptr, *cptr;
+	size_t slen, clen, qlen;
+};
+
+/* next free sqe, cleared; NULL if the submission ring is full */
+static inline struct io_uring_sqe *
+uringw_sqe(struct uring_s *u)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	if (u->stail - load_acq(*u->shead) >= u->depth)
+		return NULL;
+	idx = u->stail & *u->smask;
+	sqe = u->sqes + idx;
+	memset(sqe, 0, sizeof *sqe);
+	u->sarr[idx] = idx;
+	u->stail++;
+	u->spend++;
+	return sqe;
+}
+
+/* oldest unseen completion, or NULL */
+static inline struct io_uring_cqe *
+uringw_cqe(struct uring_s *u)
+{
+	unsigned int head = *u->chead;
+
+	if (head == load_acq(*u->ctail))
+		return NULL;
+	return u->cqes + (head & *u->cmask);
+}
+
+static inline void
+uringw_seen(struct uring_s *u)
+{
+	store_rel(*u->chead, *u->chead + 1);
+}
+
+#endif
@@ -0,0 +1 @@
+#define YANVER "bbc6b41c // 2026-10-17"
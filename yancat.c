@@ -31,6 +31,16 @@
 #include <string.h>
 #include <limits.h>
 #include <signal.h>
+#include <time.h>
+#ifdef has_splice
+# include <poll.h>
+# include <sys/mman.h>
+#endif
+#ifdef has_offload
+# include <sys/ioctl.h>
+# include <sys/sendfile.h>
+# include <linux/fs.h>
+#endif
 #ifdef h_thr
 # include <pthread.h>
 #endif
@@ -50,16 +60,25 @@
 #include "parse.h"
 #include "mtxw.h"
 #include "semw.h"
+#include "ftxw.h"
+#include "uringw.h"
 #include "shmw.h"
 #include "buffer.h"
+#include "parity.h"
 
 enum role_t {arbiter = 0, reader, writer, crcer, sigrelay};
 #define TASK_CNT 5
 
 static struct options_s g_opts;
 static struct fdpack_s g_fdi, g_fdo;
+/*
+ * striped sides (-T) - g_mem[dir][0] is g_fdi / g_fdo, the rest live in g_sfd;
+ * g_nmem[dir] is 0 if the side is not striped
+ */
+static struct fdpack_s g_sfd[2][STRIPE_MAX];
+static struct fdpack_s *g_mem[2][STRIPE_MAX];
+static size_t g_nmem[2];
 
-/* crc not implemented yet as a separate thread */
 #ifdef h_thr
 static pthread_t g_threads[TASK_CNT];
 static __thread enum role_t g_role = arbiter;
@@ -80,24 +99,53 @@ static const char *errlog_str[] = {
 
 static struct shm_s g_chunk;
 
+/*
+ * wait states of the reader and the writer are kept in separate cache lines,
+ * away from the buffer and from the flags polled by both sides
+ */
 static struct shr_s {
 	struct buf_s buf;
-	size_t xrsiz, xwsiz;
+	struct {
+		sig_atomic_t mwait;
+		size_t xrsiz;
+	} cline_aligned;
+	struct {
+		sig_atomic_t swait;
+		size_t xwsiz;
+	} cline_aligned;
+	struct {
+		sig_atomic_t cwait;
+		size_t xcsiz;
+	} cline_aligned;
+	struct {
+		sig_atomic_t abrt, done;
+	} cline_aligned;
 	int errR, errW;
-	sig_atomic_t abrt, done, mwait, swait;
 	sig_atomic_t errlog[ERRL_CNT];
 #ifndef h_mingw
 	pid_t pids[TASK_CNT];
 	struct mtx_s vars;
-	struct sem_s nospace, nodata;
+	struct sem_s nospace, nodata, nochk;
+#endif
+#ifdef has_ftx_linux
+	struct ftx_s fnospace cline_aligned;
+	struct ftx_s fnodata cline_aligned;
+	struct ftx_s fnochk cline_aligned;
+#endif
+#ifdef h_thr
+	unsigned long long int durable;
 #endif
+	unsigned long long int elidedR, elidedW;
 } *g_shm = NULL;
 
 static struct buf_s *g_buf;
 
+#ifdef has_ftx_linux
+static struct ftx_s *g_fnospace, *g_fnodata, *g_fnochk;
+#endif
 #ifndef h_mingw
 static struct mtx_s *g_vars;
-static struct sem_s *g_nospace, *g_nodata;
+static struct sem_s *g_nospace, *g_nodata, *g_nochk;
 
 static int sigs_ign[] = { SIGPIPE, SIGTTIN, SIGTTOU, SIGHUP, SIGUSR2, SIGCHLD, 0 };
 static int sigs_hnd[] = { SIGTERM, SIGINT, SIGUSR1, 0 };
@@ -148,6 +196,20 @@ static void notify_tasks(void)
 }
 #endif
 
+/* the checksum task (-E) may sleep on its own - wake it up for good */
+static void kick_crc(void)
+{
+#ifndef h_mingw
+	if (!g_nochk)
+		return;
+	Vb(g_nochk);
+#ifdef has_ftx_linux
+	if (g_fnochk)
+		ftxw_kick(g_fnochk);
+#endif
+#endif
+}
+
 /*
  * called if there was an error during initialization - release all locks, make
  * sure nothing blocks at any point; g_role is thread local, so errlog will get
@@ -167,13 +229,35 @@ static void release(unsigned int type)
 		Vb(g_nodata);
 		Vb(g_nospace);
 	}
+#ifdef has_ftx_linux
+	if (g_fnospace) {
+		ftxw_kick(g_fnodata);
+		ftxw_kick(g_fnospace);
+	}
+#endif
+	kick_crc();
 	notify_tasks();
 #endif
 }
 
 static int cleanup_arbiter(void)
 {
+#ifdef has_ftx_linux
+	if (g_fnochk) {
+		ftxw_dtor(g_fnochk);
+		g_fnochk = NULL;
+	}
+	if (g_fnospace) {
+		ftxw_dtor(g_fnodata);
+		ftxw_dtor(g_fnospace);
+		g_fnospace = g_fnodata = NULL;
+	}
+#endif
 #ifndef h_mingw
+	if (g_nochk) {
+		semw_dtor(g_nochk);
+		g_nochk = NULL;
+	}
 	if (g_opts.mode != sp) {
 		semw_dtor(g_nodata);
 		semw_dtor(g_nospace);
@@ -187,7 +271,17 @@ static int cleanup_arbiter(void)
 
 static int cleanup_child(void)
 {
+#ifdef has_ftx_linux
+	if (g_fnochk)
+		ftxw_dt(g_fnochk);
+	if (g_fnospace) {
+		ftxw_dt(g_fnodata);
+		ftxw_dt(g_fnospace);
+	}
+#endif
 #ifndef h_mingw
+	if (g_nochk)
+		semw_dt(g_nochk);
 	if (g_opts.mode != sp) {
 		semw_dt(g_nodata);
 		semw_dt(g_nospace);
@@ -276,20 +370,22 @@ static int setup_env(void)
 
 	/*
 	 * buffer object located in the above chunk; buffer itself allocates
-	 * main and bounce areas (if applicable)
+	 * the main area
 	 */
 	if ((noshr = buf_ctor(&g_shm->buf, g_opts.bsiz, g_opts.rblk, g_opts.wblk, g_opts.hpage)) < 0) {
 		fprintf (stderr, "setup_env(): buffer initialization failed.\n");
 		goto out1;
 	}
 	g_buf = &g_shm->buf;
-	if (buf_setextra(g_buf, g_opts.rline, g_opts.wline, g_opts.rcrc, g_opts.wcrc, g_opts.rsp, g_opts.wsp) < 0)
+	if (buf_setextra(g_buf, g_opts.rline, g_opts.wline, g_opts.rcrc, g_opts.wcrc, g_opts.dgst, g_opts.rsp, g_opts.wsp) < 0)
 		goto out2;
 
 	mpok = mpok && !noshr;
 
 	/* update g_opts.mode to reflect the above) */
 	g_opts.mode = mpok ? mp : (g_opts.mode == mt ? mt : sp);
+	if (g_opts.crct && g_opts.mode != sp)
+		buf_setcrct(g_buf);
 
 #ifndef h_mingw
 	if (g_opts.mode != sp) {
@@ -302,6 +398,25 @@ static int setup_env(void)
 		if (semw_ctor(&g_shm->nodata, "/yancat-nodata", g_opts.mode == mp, 0) < 0)
 			goto out4;
 		g_nodata = &g_shm->nodata;
+		if (g_opts.crct) {
+			if (semw_ctor(&g_shm->nochk, "/yancat-nochk", g_opts.mode == mp, 0) < 0)
+				goto out5;
+			g_nochk = &g_shm->nochk;
+		}
+	}
+#endif
+#ifdef has_ftx_linux
+	if (g_opts.mode != sp && g_opts.ftx) {
+		/* trivial ctors, they can't fail */
+		ftxw_ctor(&g_shm->fnospace, "nospace", g_opts.mode == mp);
+		g_fnospace = &g_shm->fnospace;
+		ftxw_ctor(&g_shm->fnodata, "nodata", g_opts.mode == mp);
+		g_fnodata = &g_shm->fnodata;
+		if (g_opts.crct) {
+			ftxw_ctor(&g_shm->fnochk, "nochk", g_opts.mode == mp);
+			g_fnochk = &g_shm->fnochk;
+		}
+		fprintf(stderr, "Futex waits enabled, spinning up to %zu ns.\n", g_opts.spin);
 	}
 #endif
 
@@ -309,6 +424,8 @@ static int setup_env(void)
 
 	return 0;
 #ifndef h_mingw
+out5:
+	semw_dtor(g_nodata);
 out4:
 	semw_dtor(g_nospace);
 out3:
@@ -375,6 +492,7 @@ static void *task_sigrelay(void *arg __attribute__ ((__unused__)));
 #endif
 static void *task_reader(void *arg __attribute__ ((__unused__)));
 static void *task_writer(void *arg __attribute__ ((__unused__)));
+static void *task_crc(void *arg __attribute__ ((__unused__)));
 static int setup_proc(void)
 {
 	int ret = 0;
@@ -385,12 +503,16 @@ static int setup_proc(void)
 	} else if (g_opts.mode == mp) {
 		pid_t p;
 		//g_pgroup = getpgrp();
-		fputs("Continuing with 2 processes.\n", stderr);
+		fprintf(stderr, "Continuing with %d processes.\n", g_opts.crct ? 3 : 2);
 		if ((p = forkself(reader)) < 0) goto outp;
 		if (!p) return 0;
 		if ((p = forkself(writer)) < 0) goto outp;
 		if (!p) return 0;
-		/* both children forked successfully */
+		if (g_opts.crct) {
+			if ((p = forkself(crcer)) < 0) goto outp;
+			if (!p) return 0;
+		}
+		/* all children forked successfully */
 #ifdef h_affi
 		/* affinity if applicable */
 		setup_proc_affinity(g_shm->pids[reader], g_opts.cpuR, "reader");
@@ -405,7 +527,7 @@ static int setup_proc(void)
 		 */
 		memset(g_threads, 0, sizeof g_threads);
 		setup_sigmask(SIG_BLOCK, sigs_unb_t);
-		fputs("Continuing with 2 threads.\n", stderr);
+		fprintf(stderr, "Continuing with %d threads.\n", g_opts.crct ? 3 : 2);
 		/* sigrelay _must_ be first  */
 		if ((ret = pthread_create(&t, NULL, task_sigrelay, "signalling thread"))) goto outt;
 		g_threads[sigrelay] = t;
@@ -413,6 +535,10 @@ static int setup_proc(void)
 		g_threads[reader] = t;
 		if ((ret = pthread_create(&t, NULL, task_writer, "writer thread"))) goto outt;
 		g_threads[writer] = t;
+		if (g_opts.crct) {
+			if ((ret = pthread_create(&t, NULL, task_crc, "checksum thread"))) goto outt;
+			g_threads[crcer] = t;
+		}
 
 #ifdef h_affi
 		/* affinity if applicable */
@@ -458,38 +584,164 @@ static int cleanup_winsock(void)
 	return 0;
 }
 
+/*
+ * expected size of the transfer - user supplied, or what's left in a regular
+ * file on the input side; 0 if unknown
+ */
+static off_t in_size(void)
+{
+	struct stat st;
+	off_t pos;
+
+	if (g_opts.psiz)
+		return (off_t)g_opts.psiz;
+#ifdef has_fmap
+	if (g_fdi.type == &_fdfile || g_fdi.type == &_fdmap) {
+#else
+	if (g_fdi.type == &_fdfile) {
+#endif
+		if (!stat(g_fdi.f.path, &st) && S_ISREG(st.st_mode))
+			return st.st_size;
+	} else if (g_fdi.type == &_fdfd && g_fdi.fd >= 0) {
+		if (!fstat(g_fdi.fd, &st) && S_ISREG(st.st_mode) && (pos = lseek(g_fdi.fd, 0, SEEK_CUR)) >= 0)
+			return st.st_size > pos ? st.st_size - pos : 0;
+	}
+	return 0;
+}
+
+static int setup_fd(struct fdpack_s *fd, int dir, struct options_s *o)
+{
+	if (!dir) {
+		if (fd_ctor(fd, 0, o->fd[0], o->fsync) < 0)
+		if (fd_ctor_f(fd, 0, o->file[0], o->fsync, o->rdio ? o->rblk : 0) < 0)
+		if (fd_ctor_m(fd, 0, o->map[0], o->fsync, o->mwin) < 0)
+		if (fd_ctor_s(fd, 0, &o->sock[0], !o->rline) < 0)
+		if (fd_ctor(fd, 0, "0", 0) < 0)
+			return -1;
+	} else {
+		if (fd_ctor(fd, 1, o->fd[1], o->fsync) < 0)
+		if (!o->zsiz || fd_ctor_z(fd, 1, o->file[1], o->fsync, (off_t)o->zsiz, (size_t)o->zrec) < 0)
+		if (fd_ctor_f(fd, 1, o->file[1], o->fsync, o->wdio ? o->wblk : 0) < 0)
+		if (fd_ctor_m(fd, 1, o->map[1], o->fsync, o->mwin) < 0)
+		if (fd_ctor_s(fd, 1, &o->sock[1], 0) < 0)
+		if (fd_ctor(fd, 1, "1", o->fsync) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* a side is either a single endpoint, or all of its -i / -o specs as a stripe set */
+static int setup_side(int dir)
+{
+	struct fdpack_s *fd = dir ? &g_fdo : &g_fdi;
+	struct options_s o;
+	size_t i;
+
+	if (!g_opts.stripe || g_opts.nmem[dir] < 2)
+		return setup_fd(fd, dir, &g_opts);
+	o = g_opts;
+	for (i = 0; i < g_opts.nmem[dir]; i++) {
+		g_mem[dir][i] = i ? &g_sfd[dir][i] : fd;
+		if (opt_spec(&o, g_opts.smem[dir][i], dir) < 0 || setup_fd(g_mem[dir][i], dir, &o) < 0) {
+			fprintf(stderr, "Bad stripe member specification: %s\n", g_opts.smem[dir][i]);
+			goto out;
+		}
+	}
+	g_nmem[dir] = i;
+	return 0;
+out:
+	while (i--)
+		fd_dtor(g_mem[dir][i]);
+	return -1;
+}
+
+static void cleanup_side(int dir)
+{
+	size_t i;
+
+	for (i = 1; i < g_nmem[dir]; i++)
+		fd_dtor(g_mem[dir][i]);
+	fd_dtor(dir ? &g_fdo : &g_fdi);
+}
+
+static void info_side(int dir)
+{
+	size_t i;
+
+	fprintf(stderr, "\nPre-open %s side", dir ? "output" : "input");
+	if (!g_nmem[dir]) {
+		fputs(":\n", stderr);
+		fd_info(dir ? &g_fdo : &g_fdi);
+		return;
+	}
+	fprintf(stderr, " (stripe set of %zu):\n", g_nmem[dir]);
+	for (i = 0; i < g_nmem[dir]; i++)
+		fd_info(g_mem[dir][i]);
+}
+
+/* the whole side - on failure, nothing is left open */
+static int open_side(int dir)
+{
+	size_t i;
+
+	if (!g_nmem[dir])
+		return fd_open(dir ? &g_fdo : &g_fdi);
+	for (i = 0; i < g_nmem[dir]; i++) {
+		if (fd_open(g_mem[dir][i]) < 0) {
+			while (i--)
+				fd_close(g_mem[dir][i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void close_side(int dir)
+{
+	size_t i;
+
+	if (!g_nmem[dir]) {
+		fd_close(dir ? &g_fdo : &g_fdi);
+		return;
+	}
+	for (i = 0; i < g_nmem[dir]; i++)
+		fd_close(g_mem[dir][i]);
+}
+
 static int setup_fds(void)
 {
-	if (fd_ctor(&g_fdi, 0, g_opts.fd[0], g_opts.fsync) < 0)
-	if (fd_ctor_f(&g_fdi, 0, g_opts.file[0], g_opts.fsync) < 0)
-	if (fd_ctor_s(&g_fdi, 0, &g_opts.sock[0], !g_opts.rline) < 0)
-	if (fd_ctor(&g_fdi, 0, "0", 0) < 0)
+	if (setup_side(0) < 0)
 		return -1;
-
-	if (fd_ctor(&g_fdo, 1, g_opts.fd[1], g_opts.fsync) < 0)
-	if (fd_ctor_f(&g_fdo, 1, g_opts.file[1], g_opts.fsync) < 0)
-	if (fd_ctor_s(&g_fdo, 1, &g_opts.sock[1], 0) < 0)
-	if (fd_ctor(&g_fdo, 1, "1", g_opts.fsync) < 0)
+	if (setup_side(1) < 0)
 		goto out;
 
-	fprintf (stderr, "\nPre-open input side:\n");
-	fd_info(&g_fdi);
-	fprintf (stderr, "\nPre-open output side:\n");
-	fd_info(&g_fdo);
+	fd_setcache(&g_fdi, g_opts.rcache);
+	fd_setcache(&g_fdo, g_opts.wcache);
+	if (!g_nmem[0] && !g_nmem[1])
+		fd_setprealloc(&g_fdo, in_size(), g_opts.pchunk);
+	if (g_opts.rsparse)
+		fd_setsparse(&g_fdi, 1);
+	if (g_opts.wsparse)
+		fd_setsparse(&g_fdo, g_opts.wblk);
+
+	info_side(0);
+	info_side(1);
 	if (g_opts.strict)
 		fputs("\nStrict reblocking writes enabled.\n", stderr);
+	if ((g_opts.rdio && g_fdi.type != &_fdfile) || (g_opts.wdio && g_fdo.type != &_fdfile))
+		fputs("\nINFO: direct i/o applies to files only.\n", stderr);
 	fflush(stderr);
 
 	return 0;
 out:
-	fd_dtor(&g_fdi);
+	cleanup_side(0);
 	return -1;
 }
 
 static void cleanup_fds(void)
 {
-	fd_dtor(&g_fdi);
-	fd_dtor(&g_fdo);
+	cleanup_side(0);
+	cleanup_side(1);
 }
 
 static void cleanup_env(void)
@@ -501,55 +753,243 @@ static void cleanup_env(void)
 	}
 }
 
+#ifdef has_splice
+/*
+ * gift mode (writer only) - buffer pages are handed over to the output pipe by
+ * reference with vmsplice(2), instead of being copied with write(2); there's
+ * no way to learn when the kernel drops its last reference to them (the
+ * consumer may splice or tee them further, or they may sit in a socket's send
+ * queue), so gifted pages are never written to again - as soon as a page is
+ * fully gifted, it's punched out of the buffer's shm file (MADV_REMOVE); the
+ * kernel keeps the old page for as long as it needs it, while the buffer gets
+ * a fresh one on the reader's next touch (in every mapping and process); a
+ * partially gifted page stays in gift until the rest of it follows
+ */
+static int g_gift;
+static size_t g_giftpg;
+
+static int gift_prep(void)
+{
+	struct stat st;
+	long int pg = sysconf(_SC_PAGESIZE);
+	int fd = fd_getfd(&g_fdo);
+	void *ptr;
+
+	if (fstat(fd, &st) < 0 || !S_ISFIFO(st.st_mode)) {
+		fputs("INFO: gift mode: output is not a pipe, using regular writes\n", stderr);
+		return -1;
+	}
+	if (pg <= 0 || g_opts.wblk % (size_t)pg) {
+		fprintf(stderr, "INFO: gift mode: writer's block is not a multiple of page size (%ld), using regular writes\n", pg);
+		return -1;
+	}
+	if (g_buf->flags & M_HUGE) {
+		fputs("INFO: gift mode: huge pages can't be replaced page by page, using regular writes\n", stderr);
+		return -1;
+	}
+	/* the buffer is already in use by the reader, so probe on a page of our own */
+	ptr = mmap(NULL, (size_t)pg, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED || madvise(ptr, (size_t)pg, MADV_REMOVE) < 0) {
+		fputs("INFO: gift mode: can't replace gifted pages (MADV_REMOVE), using regular writes\n", stderr);
+		if (ptr != MAP_FAILED)
+			munmap(ptr, (size_t)pg);
+		return -1;
+	}
+	munmap(ptr, (size_t)pg);
+	g_giftpg = (size_t)pg;
+	g_gift = 1;
+	fputs("Gift mode enabled\n", stderr);
+	return 0;
+}
+
+/*
+ * punches out the pages covering the oldest chunk of gifted data (and pad
+ * bytes past it), and releases the chunk
+ */
+static int gift_release(size_t chunk, size_t pad)
+{
+	struct iovec iov[2];
+	int i, cnt;
+
+	pad = Y_MIN((chunk + pad + g_giftpg - 1) & ~(g_giftpg - 1), g_buf->size);
+	cnt = ibuf_iov(g_buf, iov, g_buf->did, pad);
+	for (i = 0; i < cnt; i++)
+		if unlikely(madvise(iov[i].iov_base, iov[i].iov_len, MADV_REMOVE) < 0)
+			return -1;
+	buf_commit_wr(g_buf, chunk);
+	return 0;
+}
+
+/*
+ * did always stays page aligned - only whole pages are released, except at
+ * the very end (see gift_fini()), when nothing follows in the buffer anymore
+ */
+static int gift_commit(size_t siz)
+{
+	size_t n;
+
+	buf_commit_wg(g_buf, siz);
+	n = g_buf->gift & ~(g_giftpg - 1);
+	return n ? gift_release(n, 0) : 0;
+}
+
+/*
+ * the transfer is over - the partial page goes as well, along with the strict
+ * mode pad (never accounted in gift, but gifted all the same); the space past
+ * the data is free at this point, so up to wblk more is punched blindly
+ */
+static int gift_fini(void)
+{
+	return g_gift ? gift_release(g_buf->gift, g_opts.wblk) : 0;
+}
+#endif
+
+static inline int
+commit_wf_i(size_t siz)
+{
+#ifdef has_splice
+	if unlikely(g_gift)
+		return gift_commit(siz);
+#endif
+	buf_commit_wf(g_buf, siz);
+	return 0;
+}
+
+/*
+ * single iovec (the usual case with circular buffer) goes through plain calls;
+ * non-zero blk means a batch of blk sized blocks (see fd_readm())
+ */
 static inline ssize_t
-read_i(struct fdpack_s *fd, uint8_t *restrict buf, size_t blk)
+read_i(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk)
 {
 	ssize_t ret;
 	do {
-		ret = fd_read(fd, buf, blk);
+		if unlikely(blk)
+			ret = fd_readm(fd, iov, cnt, blk);
+		else if likely(cnt == 1)
+			ret = fd_read(fd, iov[0].iov_base, iov[0].iov_len);
+		else
+			ret = fd_readv(fd, iov, cnt);
 	} while (unlikely(ret < 0) && errno == EINTR && !ACCESS_ONCE(g_shm->done));
 	return ret;
 }
 
 static inline ssize_t
-write_i(struct fdpack_s *fd, const uint8_t *restrict buf, size_t blk)
+write_i(struct fdpack_s *fd, const struct iovec *iov, int cnt, size_t blk)
 {
 	ssize_t ret;
 	do {
-		ret = fd_write(fd, buf, blk);
+#ifdef has_splice
+		if unlikely(g_gift)
+			ret = vmsplice(fd_getfd(fd), iov, (unsigned long)cnt, SPLICE_F_GIFT);
+		else
+#endif
+		if unlikely(blk)
+			ret = fd_writem(fd, iov, cnt, blk);
+		else if likely(cnt == 1)
+			ret = fd_write(fd, iov[0].iov_base, iov[0].iov_len);
+		else
+			ret = fd_writev(fd, iov, cnt);
 	} while (unlikely(ret < 0) && errno == EINTR && !ACCESS_ONCE(g_shm->done));
 	return ret;
 }
 
+/*
+ * mp / mt transfer loops
+ *
+ * the fast path is lock-free - got/did are handed over with acquire/release
+ * semantics (see buffer.h); the mutex is taken only on the slow path, when
+ * one side is about to sleep, or when it has to check if the other side
+ * sleeps and can be woken up
+ *
+ * the sleeper sets [ms]wait and re-checks the buffer, the waker publishes its
+ * cursor and then checks [ms]wait; full barriers on both sides guarantee that
+ * at least one of them notices the other (so no lost wakeups)
+ */
+
+#ifdef has_ftx_linux
+/*
+ * futex alternative of the slow path: spin for up to g_opts.spin ns
+ * re-checking the buffer, then sleep on the sequence word; only the side
+ * owning the condition calls can(), so no locking is needed at all; the
+ * other side wakes us through ftxw_wake() after publishing its cursor
+ *
+ * returns 0 if the transfer is done
+ */
+static size_t wait_ftx(struct ftx_s *f, size_t (*can)(struct buf_s *restrict))
+{
+	struct timespec t0, t1;
+	unsigned int i;
+	uint32_t seq;
+	size_t siz;
+
+	if (g_opts.spin) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (i = 1;; i++) {
+			cpu_relax();
+			if ((siz = can(g_buf))) {
+				f->spun++;
+				return siz;
+			}
+			if unlikely(ACCESS_ONCE(g_shm->done))
+				return 0;
+			if (i & 63)
+				continue;
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			if ((size_t)((t1.tv_sec - t0.tv_sec) * 1000000000l + (t1.tv_nsec - t0.tv_nsec)) >= g_opts.spin)
+				break;
+		}
+	}
+	while (1) {
+		seq = ftxw_prep(f);
+		if ((siz = can(g_buf)) || ACCESS_ONCE(g_shm->done))
+			break;
+		ftxw_sleep(f, seq);
+	}
+	ftxw_done(f);
+	return ACCESS_ONCE(g_shm->done) ? 0 : siz;
+}
+#endif
+
 /* reader process */
 static void transfer_reader(void)
 {
 #ifndef h_mingw
-	uint8_t *ptrr;
+	struct iovec iov[2];
 	ssize_t retr = 1;
-	size_t siz;
+	size_t siz, bat = g_opts.rbat ? g_opts.rcnt : 1;
+	int cnt;
 
-	Pm(g_vars);
-	while likely(!g_shm->done) {
-		siz = buf_can_r(g_buf);
-		if unlikely(!siz) {
-			g_shm->mwait = 1;
-			Vm(g_vars);
-			Pb(g_nospace);
-			/*
-			 * passing this 'if' guarantees xrsiz != 0;
-			 * analogously for slave; if we're out, we save on
-			 * one semaphore call, which is always nice =)
-			 */
-			if unlikely(g_shm->done)
+	while likely(!ACCESS_ONCE(g_shm->done)) {
+		siz = buf_can_rn(g_buf, bat);
+#ifdef has_ftx_linux
+		if (unlikely(!siz) && g_fnospace) {
+			if unlikely(!(siz = wait_ftx(g_fnospace, buf_can_r)))
 				goto outt;
-			siz = g_shm->xrsiz;
-			//Pb(g_vars);
-			//continue;
 		} else
-			Vm(g_vars);
-		ptrr = buf_fetch_r(g_buf, siz);
-		retr = read_i(&g_fdi, ptrr, siz);
+#endif
+		if unlikely(!siz) {
+			Pm(g_vars);
+			g_shm->mwait = 1;
+			full_barrier();
+			if likely(!(siz = buf_can_r(g_buf))) {
+				Vm(g_vars);
+				Pb(g_nospace);
+				/*
+				 * passing this 'if' guarantees xrsiz != 0;
+				 * analogously for slave; if we're out, we save on
+				 * one semaphore call, which is always nice =)
+				 */
+				if unlikely(ACCESS_ONCE(g_shm->done))
+					goto outt;
+				siz = g_shm->xrsiz;
+			} else {
+				g_shm->mwait = 0;
+				Vm(g_vars);
+			}
+		}
+		cnt = buf_fetch_r(g_buf, iov, siz);
+		retr = read_i(&g_fdi, iov, cnt, siz > g_opts.rblk ? g_opts.rblk : 0);
 		if unlikely(retr <= 0) {
 			if (retr < 0)
 				g_shm->errR = errno;
@@ -557,16 +997,37 @@ static void transfer_reader(void)
 		}
 		/* see comments in buffer files about the split */
 		buf_commit_r(g_buf, retr);
-		Pm(g_vars);
 		buf_commit_rf(g_buf, retr);
+#ifdef has_ftx_linux
+		if (g_fnodata) {
+			ftxw_wake(g_fnodata);
+			if unlikely(g_fnochk)
+				ftxw_wake(g_fnochk);
+			continue;
+		}
+#endif
+		full_barrier();
 		/* wake up writer, if it's suspended due to data */
-		if (unlikely(g_shm->swait) && (siz = buf_can_w(g_buf))) {
-			g_shm->swait = 0;
-			g_shm->xwsiz = siz;
-			Vb(g_nodata);
+		if unlikely(ACCESS_ONCE(g_shm->swait)) {
+			Pm(g_vars);
+			if (g_shm->swait && (siz = buf_can_w(g_buf))) {
+				g_shm->swait = 0;
+				g_shm->xwsiz = siz;
+				Vb(g_nodata);
+			}
+			Vm(g_vars);
+		}
+		/* and the checksum task */
+		if unlikely(ACCESS_ONCE(g_shm->cwait)) {
+			Pm(g_vars);
+			if (g_shm->cwait && (siz = buf_can_c(g_buf))) {
+				g_shm->cwait = 0;
+				g_shm->xcsiz = siz;
+				Vb(g_nochk);
+			}
+			Vm(g_vars);
 		}
 	}
-	Vm(g_vars);
 outt:
 	/*
 	 * to avoid cmpxchg we use 2 separate flags - one set on errors /
@@ -578,149 +1039,2304 @@ outt:
 	} else if (retr == 0) {
 		//cmpxchg(g_shm->done, 0, 1);
 	}
+	/* make sure the last got is visible before done */
+	full_barrier();
 	g_shm->done = 1;
 	Vb(g_nodata);
+#ifdef has_ftx_linux
+	if (g_fnodata)
+		ftxw_kick(g_fnodata);
+#endif
+	kick_crc();
 #endif
 }
 
-static ssize_t transfer_writer_epi(void)
+/*
+ * checksum task (-E) - takes the input's crc off the reader; it trails got
+ * with its own cursor (see chk in buffer.h), sleeping on nochk when there's
+ * nothing new, and wakes the reader up just like the writer does, as both of
+ * them hold the space back; once the reader is done, whatever is left is
+ * taken before quitting
+ *
+ * with n > 1 threads, the task takes up to n blocks at once, and cuts them
+ * into parts of up to rblk bytes; the pool's threads take the crc of the
+ * parts 1 .. n-1 from 0, while the task does part 0 in place; the parts are
+ * then merged in order (see crc_combine()) - all but the last one are full
+ * blocks, so their shift operator is built only once
+ */
+#ifdef h_thr
+static struct {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv, dcv;
+	pthread_t thr[CRCT_MAX];
+	size_t pos[CRCT_MAX], len[CRCT_MAX];
+	CRCINT crc[CRCT_MAX];
+	CRCINT op[CRCBITS];
+	unsigned long long int gen;
+	size_t n, left;
+	int stop;
+} g_cpool;
+
+static void *task_cpool(void *arg)
 {
-	uint8_t *ptrw;
-	ssize_t retw = 1;
-	size_t siz, pad;
+	size_t i = (size_t)(uintptr_t)arg, pos, len;
+	unsigned long long int gen = 0;
+	CRCINT crc;
 
-	buf_setlinew(g_buf);
-	while likely(siz = buf_can_w(g_buf)) {
-		if (unlikely(siz < g_opts.wblk) && g_opts.strict) {
-			ptrw = buf_forcefetch_w(g_buf, siz);
-			pad = g_opts.wblk - siz;
-			memset(ptrw + siz, 0, pad);
-			fprintf (stderr, "INFO: strict mode writer: padding with %zu 0s\n", pad);
-		} else {
-			ptrw = buf_fetch_w(g_buf, siz);
-			pad = 0;
-		}
-		retw = write_i(&g_fdo, ptrw, siz + pad);
-		if unlikely(retw < 0) {
-			g_shm->errW = errno;
+	pthread_mutex_lock(&g_cpool.mtx);
+	while (1) {
+		while (g_cpool.gen == gen && !g_cpool.stop)
+			pthread_cond_wait(&g_cpool.cv, &g_cpool.mtx);
+		if (g_cpool.stop)
+			break;
+		gen = g_cpool.gen;
+		if (!(len = g_cpool.len[i]))
+			continue;
+		pos = g_cpool.pos[i];
+		pthread_mutex_unlock(&g_cpool.mtx);
+		crc = ibuf_crc(g_buf, 0, pos, len);
+		pthread_mutex_lock(&g_cpool.mtx);
+		g_cpool.crc[i] = crc;
+		if (!--g_cpool.left)
+			pthread_cond_signal(&g_cpool.dcv);
+	}
+	pthread_mutex_unlock(&g_cpool.mtx);
+	return NULL;
+}
+
+static void cpool_stop(void)
+{
+	size_t i;
+
+	pthread_mutex_lock(&g_cpool.mtx);
+	g_cpool.stop = 1;
+	pthread_cond_broadcast(&g_cpool.cv);
+	pthread_mutex_unlock(&g_cpool.mtx);
+	for (i = 1; i < g_cpool.n; i++)
+		pthread_join(g_cpool.thr[i], NULL);
+	pthread_cond_destroy(&g_cpool.dcv);
+	pthread_cond_destroy(&g_cpool.cv);
+	pthread_mutex_destroy(&g_cpool.mtx);
+	g_cpool.n = 1;
+}
+
+/* returns the number of threads actually running (including the task) */
+static size_t cpool_start(size_t n)
+{
+	int err;
+
+	g_cpool.n = 1;
+	if (n < 2)
+		return 1;
+	pthread_mutex_init(&g_cpool.mtx, NULL);
+	pthread_cond_init(&g_cpool.cv, NULL);
+	pthread_cond_init(&g_cpool.dcv, NULL);
+	g_cpool.gen = 0;
+	g_cpool.stop = 0;
+	crc_shift_op(g_cpool.op, g_buf->rblk);
+	for (; g_cpool.n < n; g_cpool.n++) {
+		if ((err = pthread_create(&g_cpool.thr[g_cpool.n], NULL, task_cpool, (void *)(uintptr_t)g_cpool.n))) {
+			fprintf(stderr, "WARN: checksum pool: pthread_create(): %s\n", strerror(err));
 			break;
 		}
-		if (unlikely((size_t)retw < g_opts.wblk) && g_opts.strict)
-			fprintf(stderr, "ALERT: strict mode writer wrote %zd instead of %zu\n", retw, g_opts.wblk);
-		buf_commit_w(g_buf, retw);
-		/* siz is before padding, and it's the only amount we can commit with did/got values in buf */
-		if unlikely(siz > retw)
-			siz = retw;
-		buf_commit_wf(g_buf, siz);
 	}
-	return retw;
+	return g_cpool.n;
 }
 
-static void transfer_writer(void)
+static void cpool_take(size_t siz)
+{
+	size_t i, k, off, len0 = Y_MIN(siz, g_buf->rblk);
+
+	pthread_mutex_lock(&g_cpool.mtx);
+	for (i = 1, k = 0, off = len0; i < g_cpool.n; i++) {
+		g_cpool.pos[i] = (g_buf->chk + off) & g_buf->mask;
+		g_cpool.len[i] = Y_MIN(siz - off, g_buf->rblk);
+		off += g_cpool.len[i];
+		k += !!g_cpool.len[i];
+	}
+	if ((g_cpool.left = k)) {
+		g_cpool.gen++;
+		pthread_cond_broadcast(&g_cpool.cv);
+	}
+	pthread_mutex_unlock(&g_cpool.mtx);
+
+	buf_commit_c(g_buf, len0);
+	if (k) {
+		pthread_mutex_lock(&g_cpool.mtx);
+		while (g_cpool.left)
+			pthread_cond_wait(&g_cpool.dcv, &g_cpool.mtx);
+		pthread_mutex_unlock(&g_cpool.mtx);
+		for (i = 1; i <= k; i++) {
+			if likely(g_cpool.len[i] == g_buf->rblk)
+				g_buf->cdg.u.crc = crc_shift(g_cpool.op, g_buf->cdg.u.crc) ^ g_cpool.crc[i];
+			else
+				g_buf->cdg.u.crc = crc_combine(g_buf->cdg.u.crc, g_cpool.crc[i], g_cpool.len[i]);
+		}
+	}
+	buf_commit_cf(g_buf, siz);
+}
+#endif
+
+static size_t wait_crc(void)
 {
 #ifndef h_mingw
-	uint8_t *ptrw;
-	ssize_t retw = 1;
 	size_t siz;
 
+#ifdef has_ftx_linux
+	if (g_fnochk)
+		return wait_ftx(g_fnochk, buf_can_c);
+#endif
 	Pm(g_vars);
-	while likely(!g_shm->done) {
-		siz = buf_can_w(g_buf);
+	g_shm->cwait = 1;
+	full_barrier();
+	if likely(!(siz = buf_can_c(g_buf))) {
+		Vm(g_vars);
+		Pb(g_nochk);
+		if unlikely(ACCESS_ONCE(g_shm->done))
+			return 0;
+		return g_shm->xcsiz;
+	}
+	g_shm->cwait = 0;
+	Vm(g_vars);
+	return siz;
+#else
+	return 0;
+#endif
+}
+
+static void transfer_crc(void)
+{
+#ifndef h_mingw
+	size_t siz, n = 1;
+
+#ifdef h_thr
+	n = cpool_start(g_opts.crct);
+#endif
+	while (1) {
+		siz = buf_can_cn(g_buf, n);
 		if unlikely(!siz) {
-			g_shm->swait = 1;
-			Vm(g_vars);
-			Pb(g_nodata);
-			if unlikely(g_shm->done)
-				goto outt;
-			siz = g_shm->xwsiz;
-			//Pm(g_vars);
-			//continue;
-		} else
+			if (ACCESS_ONCE(g_shm->done)) {
+				/* pairs with the barrier before reader's final done */
+				full_barrier();
+				if (g_shm->abrt || !(siz = buf_can_cn(g_buf, n)))
+					break;
+			} else if (!wait_crc())
+				continue;
+			else
+				siz = buf_can_cn(g_buf, n);
+		}
+#ifdef h_thr
+		if (n > 1)
+			cpool_take(siz);
+		else
+#endif
+		{
+			buf_commit_c(g_buf, siz);
+			buf_commit_cf(g_buf, siz);
+		}
+#ifdef has_ftx_linux
+		if (g_fnospace) {
+			ftxw_wake(g_fnospace);
+			continue;
+		}
+#endif
+		full_barrier();
+		/* wake up reader, if it's suspended due to nospace */
+		if unlikely(ACCESS_ONCE(g_shm->mwait)) {
+			Pm(g_vars);
+			if (g_shm->mwait && (siz = buf_can_r(g_buf))) {
+				g_shm->mwait = 0;
+				g_shm->xrsiz = siz;
+				Vb(g_nospace);
+			}
 			Vm(g_vars);
-		ptrw = buf_fetch_w(g_buf, siz);
-		retw = write_i(&g_fdo, ptrw, siz);
-		if unlikely(retw < 0) {
-			g_shm->errW = errno;
-			goto outt;
+		}
+	}
+#ifdef h_thr
+	if (n > 1)
+		cpool_stop();
+#endif
+	buf_crct_fin(g_buf);
+#endif
+}
+
+#ifdef h_thr
+/*
+ * parallel readers - a seekable input range is read with preadv() by
+ * g_opts.rpar threads; each one reserves the next block of the range together
+ * with its place in the buffer, reads it, and then waits for its turn to
+ * commit - so the writer still sees a strictly sequential stream
+ *
+ * reservations are serialized by rmtx - the reserving thread is also the only
+ * one that may wait for free space, through the usual slow path; commits are
+ * serialized by the ticket under cmtx; a short read means the end of the
+ * data (or that the file shrank), nothing past it is committed
+ *
+ * a striped input (-T) works the same way, with one thread per data member;
+ * the threads take their turns to reserve round-robin, so the blocks (stripe
+ * units) of member k are the ones with seq % n == k, read sequentially
+ *
+ * if the set has parity members, the parity thread reads them alongside, and
+ * takes the turns of the missing data members; once all the present units of
+ * a row are read, it rebuilds the missing ones right in the buffer (or just
+ * verifies the row if nothing is missing) and moves prow past it - no unit of
+ * a row is committed before that
+ */
+static struct {
+	pthread_mutex_t rmtx, cmtx;
+	pthread_cond_t ccv, rcv, pcv;
+	unsigned long long int seq, ticket, prow, bad;
+	off_t next, end;
+	size_t n, npty, nmiss, miss[PTY_MAX], slots, *rpos, *rcnt;
+	struct fdpack_s *mem[STRIPE_MAX];
+	int fd, stop, eof, pty;
+} g_par;
+
+/*
+ * stripe member header - magic, version, member index, member count, parity
+ * member count, stripe unit; all big endian
+ *
+ * parity members end with a trailer - magic and the length of the data
+ */
+#define STRIPE_HDR 32
+#define STRIPE_TRL 16
+static const char stripe_magic[8] = "YCSTRIPE";
+static const char parity_magic[8] = "YCPARITY";
+
+static void iov_adv(struct iovec *iov, int *cnt, size_t n)
+{
+	while (*cnt && n >= iov[0].iov_len) {
+		n -= iov[0].iov_len;
+		iov[0] = iov[1];
+		(*cnt)--;
+	}
+	if (*cnt) {
+		iov[0].iov_base = (uint8_t *)iov[0].iov_base + n;
+		iov[0].iov_len -= n;
+	}
+}
+
+/* full read / write of a stripe unit (or header), short only at the end of data */
+static ssize_t stripe_io(struct fdpack_s *fd, struct iovec *iov, int cnt, size_t len)
+{
+	size_t tot = 0;
+	ssize_t ret;
+
+	while (tot < len) {
+		ret = fd->dir ? fd_writev(fd, iov, cnt) : fd_readv(fd, iov, cnt);
+		if unlikely(ret < 0) {
+			if (errno == EINTR && !ACCESS_ONCE(g_shm->done))
+				continue;
+			return -1;
+		}
+		if (!ret)
+			break;
+		tot += (size_t)ret;
+		iov_adv(iov, &cnt, (size_t)ret);
+	}
+	return (ssize_t)tot;
+}
+
+static ssize_t stripe_buf(struct fdpack_s *fd, void *ptr, size_t len)
+{
+	struct iovec iov = { ptr, len };
+
+	return stripe_io(fd, &iov, 1, len);
+}
+
+static uint64_t get_be(const uint8_t *p, int len)
+{
+	uint64_t v = 0;
+
+	while (len--)
+		v = v << 8 | *p++;
+	return v;
+}
+
+static void put_be(uint8_t *p, uint64_t v, int len)
+{
+	while (len--) {
+		p[len] = (uint8_t)v;
+		v >>= 8;
+	}
+}
+
+static int stripe_hdr_w(struct fdpack_s *fd, size_t idx, size_t cnt, size_t npty, size_t unit)
+{
+	uint8_t hdr[STRIPE_HDR] = { 0 };
+
+	memcpy(hdr, stripe_magic, sizeof stripe_magic);
+	put_be(hdr + 8, 1, 4);
+	put_be(hdr + 12, idx, 4);
+	put_be(hdr + 16, cnt, 4);
+	put_be(hdr + 20, npty, 4);
+	put_be(hdr + 24, unit, 8);
+	return stripe_buf(fd, hdr, sizeof hdr) == sizeof hdr ? 0 : -1;
+}
+
+/* reads all headers, and maps the members to their places in the set */
+static int stripe_hdr_r(void)
+{
+	uint8_t hdr[STRIPE_HDR];
+	size_t i, idx, cnt = 0, npty = 0, n = g_nmem[0];
+
+	for (i = 0; i < n; i++) {
+		if (stripe_buf(g_mem[0][i], hdr, sizeof hdr) != sizeof hdr ||
+		    memcmp(hdr, stripe_magic, sizeof stripe_magic) || get_be(hdr + 8, 4) != 1) {
+			fprintf(stderr, "Stripe member %s: missing or invalid header.\n", g_opts.smem[0][i]);
+			return -1;
+		}
+		idx = (size_t)get_be(hdr + 12, 4);
+		if (!i) {
+			cnt = (size_t)get_be(hdr + 16, 4);
+			npty = (size_t)get_be(hdr + 20, 4);
+		}
+		if (get_be(hdr + 16, 4) != cnt || get_be(hdr + 20, 4) != npty ||
+		    cnt > STRIPE_MAX || npty > PTY_MAX || cnt < npty + 2 || idx >= cnt || g_par.mem[idx]) {
+			fprintf(stderr, "Stripe member %s: index %zu doesn't fit the set of the other members.\n", g_opts.smem[0][i], idx);
+			return -1;
+		}
+		if (get_be(hdr + 24, 8) != g_opts.rblk) {
+			fprintf(stderr, "Stripe unit is %llu, the input block size (-b) must match.\n",
+					(unsigned long long)get_be(hdr + 24, 8));
+			return -1;
+		}
+		g_par.mem[idx] = g_mem[0][i];
+	}
+	g_par.n = cnt - npty;
+	g_par.npty = npty;
+	for (i = g_par.n; i < cnt; i++)
+		g_par.pty += !!g_par.mem[i];
+	for (i = 0; i < g_par.n; i++) {
+		if (g_par.mem[i])
+			continue;
+		/* 1 missing member needs P or Q, 2 need both */
+		if (g_par.nmiss == (size_t)g_par.pty) {
+			fprintf(stderr, "Stripe set of %zu (%zu parity): too many members missing.\n", cnt, npty);
+			return -1;
+		}
+		g_par.miss[g_par.nmiss++] = i;
+	}
+	if (g_par.pty && g_opts.rblk <= STRIPE_TRL) {
+		fputs("Stripe unit too small for parity.\n", stderr);
+		return -1;
+	}
+	if (g_par.pty && g_buf->size < 2 * g_par.n * g_opts.rblk) {
+		fprintf(stderr, "Buffer too small for parity - must hold at least 2 rows of the stripe (%zu).\n", 2 * g_par.n * g_opts.rblk);
+		return -1;
+	}
+	return 0;
+}
+
+static void rpar_abort(void)
+{
+	pthread_mutex_lock(&g_par.cmtx);
+	g_par.stop = 1;
+	pthread_cond_broadcast(&g_par.ccv);
+	pthread_cond_broadcast(&g_par.pcv);
+	pthread_mutex_unlock(&g_par.cmtx);
+	pthread_mutex_lock(&g_par.rmtx);
+	pthread_cond_broadcast(&g_par.rcv);
+	pthread_mutex_unlock(&g_par.rmtx);
+	g_shm->errlog[ERR_ERR + g_role] = 1;
+	g_shm->abrt = 1;
+	full_barrier();
+	g_shm->done = 1;
+	/* both sides might be asleep at this point */
+	Vb(g_nodata);
+	Vb(g_nospace);
+#ifdef has_ftx_linux
+	if (g_fnodata) {
+		ftxw_kick(g_fnodata);
+		ftxw_kick(g_fnospace);
+	}
+#endif
+}
+
+/* called with rmtx held */
+static size_t rpar_space(void)
+{
+	size_t siz;
+
+	if likely(siz = buf_can_rs(g_buf))
+		return siz;
+#ifdef has_ftx_linux
+	if (g_fnospace)
+		return wait_ftx(g_fnospace, buf_can_rs);
+#endif
+	while (!(siz = buf_can_rs(g_buf))) {
+		Pm(g_vars);
+		g_shm->mwait = 1;
+		full_barrier();
+		if likely(!(siz = buf_can_rs(g_buf))) {
+			Vm(g_vars);
+			Pb(g_nospace);
+		} else {
+			g_shm->mwait = 0;
+			Vm(g_vars);
+		}
+		if unlikely(ACCESS_ONCE(g_shm->done))
+			return 0;
+	}
+	return siz;
+}
+
+/*
+ * takes member k's turn (striped input) and reserves the next chunk; returns
+ * 0 if there's nothing more to read
+ */
+static size_t rpar_reserve(size_t k, struct iovec *iov, int *cnt, off_t *off, unsigned long long int *seq)
+{
+	size_t siz, len;
+
+	pthread_mutex_lock(&g_par.rmtx);
+	while (g_par.n && g_par.seq % g_par.n != k && !g_par.eof && !g_par.stop)
+		pthread_cond_wait(&g_par.rcv, &g_par.rmtx);
+	if (g_par.next >= g_par.end || g_par.eof || g_par.stop || ACCESS_ONCE(g_shm->done) || !(siz = rpar_space())) {
+		pthread_mutex_unlock(&g_par.rmtx);
+		return 0;
+	}
+	len = (size_t)Y_MIN((off_t)siz, g_par.end - g_par.next);
+	*off = g_par.next;
+	g_par.next += (off_t)len;
+	*seq = g_par.seq++;
+	if (g_par.pty && *seq % g_par.n == 0)
+		g_par.rpos[*seq / g_par.n % g_par.slots] = g_buf->res;
+	*cnt = buf_reserve_r(g_buf, iov, len);
+	if (g_par.n)
+		pthread_cond_broadcast(&g_par.rcv);
+	pthread_mutex_unlock(&g_par.rmtx);
+	return len;
+}
+
+/* commits ret bytes of the chunk seq in order; 0 if the transfer is stopped */
+static int rpar_commit(unsigned long long int seq, size_t ret, size_t len)
+{
+	unsigned long long int row = g_par.n ? seq / g_par.n : 0;
+	size_t siz;
+
+	pthread_mutex_lock(&g_par.cmtx);
+	while ((g_par.ticket != seq || (g_par.pty && g_par.prow <= row && !g_par.eof)) && !g_par.stop)
+		pthread_cond_wait(&g_par.ccv, &g_par.cmtx);
+	pthread_mutex_unlock(&g_par.cmtx);
+	if unlikely(g_par.stop)
+		return 0;
+
+	if (likely(ret) && !g_par.eof) {
+		buf_commit_r(g_buf, ret);
+		buf_commit_rf(g_buf, ret);
+#ifdef has_ftx_linux
+		if (g_fnodata)
+			ftxw_wake(g_fnodata);
+		else
+#endif
+		{
+			full_barrier();
+			if unlikely(ACCESS_ONCE(g_shm->swait)) {
+				Pm(g_vars);
+				if (g_shm->swait && (siz = buf_can_w(g_buf))) {
+					g_shm->swait = 0;
+					g_shm->xwsiz = siz;
+					Vb(g_nodata);
+				}
+				Vm(g_vars);
+			}
+		}
+	}
+	if unlikely(ret < len) {
+		pthread_mutex_lock(&g_par.rmtx);
+		g_par.eof = 1;
+		pthread_cond_broadcast(&g_par.rcv);
+		pthread_mutex_unlock(&g_par.rmtx);
+	}
+
+	pthread_mutex_lock(&g_par.cmtx);
+	g_par.ticket++;
+	pthread_cond_broadcast(&g_par.ccv);
+	if unlikely(ret < len)
+		pthread_cond_broadcast(&g_par.pcv);
+	pthread_mutex_unlock(&g_par.cmtx);
+	return 1;
+}
+
+static ssize_t rpar_read(struct iovec *iov, int cnt, off_t off, size_t len)
+{
+	size_t tot = 0;
+	ssize_t ret;
+
+	while (tot < len) {
+		ret = preadv(g_par.fd, iov, cnt, off + (off_t)tot);
+		if unlikely(ret < 0) {
+			if (errno == EINTR && !ACCESS_ONCE(g_shm->done))
+				continue;
+			return -1;
+		}
+		if (!ret)
+			break;
+		tot += (size_t)ret;
+		iov_adv(iov, &cnt, (size_t)ret);
+	}
+	return (ssize_t)tot;
+}
+
+static void *task_rpar(void *arg)
+{
+	struct iovec iov[2];
+	unsigned long long int seq;
+	size_t len, k = (size_t)(uintptr_t)arg;
+	ssize_t ret;
+	off_t off;
+	int cnt;
+
+	g_role = reader;
+	while ((len = rpar_reserve(k, iov, &cnt, &off, &seq))) {
+		if (g_par.n)
+			ret = stripe_io(g_par.mem[k], iov, cnt, len);
+		else
+			ret = rpar_read(iov, cnt, off, len);
+		if unlikely(ret < 0) {
+			g_shm->errR = errno;
+			rpar_abort();
+			break;
+		}
+		if (g_par.pty) {
+			pthread_mutex_lock(&g_par.cmtx);
+			g_par.rcnt[seq / g_par.n % g_par.slots]++;
+			pthread_cond_broadcast(&g_par.pcv);
+			pthread_mutex_unlock(&g_par.cmtx);
+		}
+		if (!rpar_commit(seq, (size_t)ret, len))
+			break;
+	}
+	return NULL;
+}
+
+/* unit i of the row at pos, limited to len bytes */
+static int row_unit(struct iovec *iov, size_t pos, size_t i, size_t unit, size_t len)
+{
+	return ibuf_iov(g_buf, iov, (pos + i * unit) & g_buf->mask, len);
+}
+
+/*
+ * syndromes of the row of n units at pos, over the lengths len[] and skipping
+ * the members in skip; q is computed with horner's rule, from the last member
+ * down
+ */
+static void row_pq(uint8_t *p, uint8_t *q, size_t pos, size_t n, size_t unit, const size_t *len, int skip)
+{
+	struct iovec iov[2];
+	size_t i, off;
+	int j, cnt;
+
+	if (p)
+		memset(p, 0, unit);
+	if (q)
+		memset(q, 0, unit);
+	for (i = n; i--; ) {
+		if (q)
+			pty_mul2(q, unit);
+		if (skip & (1 << i) || !len[i])
+			continue;
+		cnt = row_unit(iov, pos, i, unit, len[i]);
+		for (j = 0, off = 0; j < cnt; off += iov[j].iov_len, j++) {
+			if (p)
+				pty_xor(p + off, iov[j].iov_base, iov[j].iov_len);
+			if (q)
+				pty_xor(q + off, iov[j].iov_base, iov[j].iov_len);
+		}
+	}
+}
+
+static void row_put(size_t pos, size_t i, const uint8_t *src, size_t len)
+{
+	struct iovec iov[2];
+	int j, cnt;
+
+	cnt = row_unit(iov, pos, i, g_opts.rblk, len);
+	for (j = 0; j < cnt; src += iov[j].iov_len, j++)
+		memcpy(iov[j].iov_base, src, iov[j].iov_len);
+}
+
+/*
+ * the parity thread - see the comment at g_par; the parity members are read a
+ * unit ahead, so the trailer (and the exact length of the data) is known by
+ * the time the last row is processed
+ */
+static void *task_rpty(void *arg __attribute__ ((__unused__)))
+{
+	struct iovec iov[PTY_MAX][2];
+	unsigned long long int row, seq[PTY_MAX];
+	uint8_t *buf, *cur[PTY_MAX], *nxt[PTY_MAX], *tmp, *p, *q, *r;
+	size_t i, x, y, pos, nres = 0, len[STRIPE_MAX], unit = g_opts.rblk, n = g_par.n;
+	ssize_t clen[PTY_MAX], nlen[PTY_MAX];
+	uint64_t tot = ~0ull;
+	int skip, cnt, fin = 0;
+	off_t off;
+	uint8_t a, b;
+
+	g_role = reader;
+	if (!(buf = malloc((2 * PTY_MAX + 3) * unit))) {
+		ERRG("malloc()");
+		rpar_abort();
+		return NULL;
+	}
+	for (i = 0; i < PTY_MAX; i++) {
+		cur[i] = buf + 2 * i * unit;
+		nxt[i] = cur[i] + unit;
+		nlen[i] = i < g_par.npty && g_par.mem[n + i] ? stripe_buf(g_par.mem[n + i], nxt[i], unit) : 0;
+	}
+	p = buf + 2 * PTY_MAX * unit;
+	q = p + unit;
+	r = q + unit;
+	skip = 0;
+	for (i = 0; i < g_par.nmiss; i++)
+		skip |= 1 << g_par.miss[i];
+
+	for (row = 0; !fin; row++) {
+		/* the turns of the missing members */
+		for (nres = 0; nres < g_par.nmiss; nres++) {
+			if (!rpar_reserve(g_par.miss[nres], iov[nres], &cnt, &off, seq + nres))
+				goto out;
+		}
+		/* the next parity unit */
+		for (i = 0; i < g_par.npty; i++) {
+			if (!g_par.mem[n + i])
+				continue;
+			tmp = cur[i], cur[i] = nxt[i], nxt[i] = tmp;
+			clen[i] = nlen[i];
+			if (clen[i] < 0)
+				goto err;
+			if ((size_t)clen[i] == unit)
+				nlen[i] = stripe_buf(g_par.mem[n + i], nxt[i], unit);
+			if ((size_t)clen[i] == STRIPE_TRL && !memcmp(cur[i], parity_magic, sizeof parity_magic))
+				tot = get_be(cur[i] + 8, 8), fin = 1;
+			else if ((size_t)nlen[i] == STRIPE_TRL && !memcmp(nxt[i], parity_magic, sizeof parity_magic))
+				tot = get_be(nxt[i] + 8, 8);
+			else if ((size_t)clen[i] != unit)
+				goto bad;
+		}
+		for (i = 0; i < n; i++) {
+			if (tot == ~0ull || tot >= (row * n + i + 1) * unit)
+				len[i] = unit;
+			else if (tot > (row * n + i) * unit)
+				len[i] = (size_t)(tot - (row * n + i) * unit);
+			else
+				len[i] = 0;
+		}
+
+		/* wait for the present units */
+		pthread_mutex_lock(&g_par.cmtx);
+		while (g_par.rcnt[row % g_par.slots] < n - g_par.nmiss && !g_par.eof && !g_par.stop)
+			pthread_cond_wait(&g_par.pcv, &g_par.cmtx);
+		g_par.rcnt[row % g_par.slots] = 0;
+		pthread_mutex_unlock(&g_par.cmtx);
+		if (g_par.eof || g_par.stop)
+			goto out;
+		pos = g_par.rpos[row % g_par.slots];
+
+		x = g_par.miss[0];
+		y = g_par.miss[1];
+		if (fin)
+			;
+		else if (!g_par.nmiss) {
+			row_pq(p, g_par.npty > 1 ? q : NULL, pos, n, unit, len, 0);
+			if ((g_par.mem[n] && memcmp(p, cur[0], unit)) || (g_par.npty > 1 && g_par.mem[n + 1] && memcmp(q, cur[1], unit))) {
+				if (!g_par.bad++)
+					fprintf(stderr, "Parity mismatch in stripe row %llu.\n", row);
+			}
+		} else if (g_par.nmiss == 1 && g_par.mem[n]) {
+			/* D_x = P ^ sum(D_i) */
+			row_pq(p, NULL, pos, n, unit, len, skip);
+			pty_xor(p, cur[0], unit);
+			row_put(pos, x, p, len[x]);
+		} else if (g_par.nmiss == 1) {
+			/* D_x = (Q ^ sum(g^i * D_i)) * g^-x */
+			row_pq(NULL, q, pos, n, unit, len, skip);
+			pty_xor(q, cur[1], unit);
+			memset(p, 0, unit);
+			pty_mul(p, q, pty_gpow(-(int)x), unit);
+			row_put(pos, x, p, len[x]);
+		} else {
+			/*
+			 * D_x = A * Pxy ^ B * Qxy, D_y = Pxy ^ D_x, where Pxy and Qxy
+			 * are the syndromes without x and y, and
+			 * A = g^(y-x) / (g^(y-x) ^ 1), B = g^-x / (g^(y-x) ^ 1)
+			 */
+			row_pq(p, q, pos, n, unit, len, skip);
+			pty_xor(p, cur[0], unit);
+			pty_xor(q, cur[1], unit);
+			a = pty_gpow((int)(y - x));
+			b = pty_ginv(a ^ 1);
+			memset(r, 0, unit);
+			pty_mul(r, p, pty_gmul(a, b), unit);
+			pty_mul(r, q, pty_gmul(pty_gpow(-(int)x), b), unit);
+			row_put(pos, x, r, len[x]);
+			pty_xor(p, r, unit);
+			row_put(pos, y, p, len[y]);
+		}
+		pthread_mutex_lock(&g_par.cmtx);
+		g_par.prow = row + 1;
+		pthread_cond_broadcast(&g_par.ccv);
+		pthread_mutex_unlock(&g_par.cmtx);
+
+		for (i = 0; i < nres; i++) {
+			if (!rpar_commit(seq[i], fin ? 0 : len[g_par.miss[i]], unit))
+				break;
+		}
+		nres = 0;
+	}
+	goto out;
+bad:
+	fprintf(stderr, "Stripe set: parity member truncated or corrupted in row %llu.\n", row);
+	errno = EIO;
+err:
+	g_shm->errR = errno;
+	rpar_abort();
+out:
+	pthread_mutex_lock(&g_par.cmtx);
+	g_par.prow = ~0ull;
+	pthread_cond_broadcast(&g_par.ccv);
+	pthread_mutex_unlock(&g_par.cmtx);
+	/* the reserved chunks past the end still have to pass their tickets */
+	for (i = 0; i < nres; i++)
+		rpar_commit(seq[i], 0, unit);
+	pthread_mutex_lock(&g_par.cmtx);
+	pthread_cond_broadcast(&g_par.ccv);
+	pthread_mutex_unlock(&g_par.cmtx);
+	free(buf);
+	return NULL;
+}
+
+/* returns -1 if the input is not suitable - the caller falls back to a single reader */
+static int transfer_rpar(void)
+{
+	pthread_t thr[Y_MAX(g_opts.rpar, STRIPE_MAX)];
+	struct stat st;
+	size_t i, n, want, dio;
+	off_t pos, tail = 0;
+
+	g_par.next = 0;
+	g_par.end = (off_t)(~0ull >> 1);
+	g_par.n = g_par.npty = g_par.nmiss = 0;
+	g_par.pty = 0;
+	memset(g_par.mem, 0, sizeof g_par.mem);
+	memset(g_par.miss, 0, sizeof g_par.miss);
+	if (g_nmem[0]) {
+		if (stripe_hdr_r() < 0) {
+			g_shm->errlog[ERR_ERR + g_role] = 1;
+			g_shm->abrt = 1;
+			goto out;
+		}
+		want = g_par.n;
+	} else {
+		g_par.fd = fd_getfd(&g_fdi);
+		if (g_fdi.type == &_fdsock || fstat(g_par.fd, &st) < 0 || !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+			fputs("INFO: parallel readers: input is not a regular file or a block device, using a single reader\n", stderr);
+			return -1;
+		}
+		if ((pos = lseek(g_par.fd, 0, SEEK_CUR)) < 0)
+			pos = 0;
+		g_par.end = S_ISREG(st.st_mode) ? st.st_size : lseek(g_par.fd, 0, SEEK_END);
+		g_par.next = Y_MIN(pos + (off_t)g_opts.rskip, g_par.end);
+		if (g_opts.rcount)
+			g_par.end = Y_MIN(g_par.end, g_par.next + (off_t)g_opts.rcount);
+		want = g_opts.rpar;
+		/*
+		 * the readers share the descriptor, so direct i/o is settled
+		 * here - an unaligned start turns it off, an unaligned end is
+		 * kept out of the parallel range and read at the very end,
+		 * alone and without it
+		 */
+		if ((dio = fd_getdio(&g_fdi))) {
+			if (g_par.next % (off_t)dio)
+				fd_nodirect(&g_fdi);
+			else {
+				tail = (g_par.end - g_par.next) % (off_t)dio;
+				g_par.end -= tail;
+			}
+		}
+	}
+	g_par.seq = g_par.ticket = g_par.prow = g_par.bad = 0;
+	g_par.stop = g_par.eof = 0;
+	g_par.rpos = g_par.rcnt = NULL;
+	if (g_par.pty) {
+		pty_init();
+		g_par.slots = g_buf->size / (g_par.n * g_opts.rblk) + 2;
+		if (!(g_par.rpos = calloc(2 * g_par.slots, sizeof *g_par.rpos))) {
+			ERRG("calloc()");
+			g_shm->errlog[ERR_ERR + g_role] = 1;
+			g_shm->abrt = 1;
+			goto out;
+		}
+		g_par.rcnt = g_par.rpos + g_par.slots;
+	}
+	pthread_mutex_init(&g_par.rmtx, NULL);
+	pthread_mutex_init(&g_par.cmtx, NULL);
+	pthread_cond_init(&g_par.ccv, NULL);
+	pthread_cond_init(&g_par.rcv, NULL);
+	pthread_cond_init(&g_par.pcv, NULL);
+	g_buf->res = g_buf->got;
+
+	/* data members (or just readers), then the parity thread */
+	for (n = 0, i = 0; i < want + !!g_par.pty; i++) {
+		if (g_par.n && i < g_par.n && !g_par.mem[i])
+			continue;
+		if (pthread_create(thr + n, NULL, i < want ? task_rpar : task_rpty, (void *)(uintptr_t)i)) {
+			ERRG("pthread_create()");
+			break;
+		}
+		n++;
+	}
+	if (!n || (i < want + !!g_par.pty && g_par.n))
+		rpar_abort();
+	else if (g_par.n) {
+		g_buf->path = "stripe set";
+		fprintf(stderr, "Striped input: %zu data members, %zu parity, unit %zu\n", g_par.n, g_par.npty, g_opts.rblk);
+		for (i = 0; i < g_par.nmiss; i++)
+			fprintf(stderr, "INFO: stripe member %zu is missing, rebuilding it from parity\n", g_par.miss[i]);
+	} else {
+		g_buf->path = "parallel readers";
+		fprintf(stderr, "Parallel readers: %zu, range: %lld - %lld\n", n, (long long)g_par.next, (long long)(g_par.end + tail));
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(thr[i], NULL);
+	if (tail && n && !g_par.eof && !g_par.stop) {
+		fd_nodirect(&g_fdi);
+		g_par.end += tail;
+		task_rpar(NULL);
+	}
+	if (g_par.bad) {
+		fprintf(stderr, "Parity mismatch in %llu stripe row(s).\n", g_par.bad);
+		g_shm->errlog[ERR_ERR + g_role] = 1;
+	}
+
+	pthread_cond_destroy(&g_par.pcv);
+	pthread_cond_destroy(&g_par.rcv);
+	pthread_cond_destroy(&g_par.ccv);
+	pthread_mutex_destroy(&g_par.cmtx);
+	pthread_mutex_destroy(&g_par.rmtx);
+	free(g_par.rpos);
+out:
+	/* make sure the last got is visible before done */
+	full_barrier();
+	g_shm->done = 1;
+	Vb(g_nodata);
+#ifdef has_ftx_linux
+	if (g_fnodata)
+		ftxw_kick(g_fnodata);
+#endif
+	return 0;
+}
+#endif
+
+static ssize_t transfer_writer_epi(struct fdpack_s *fd)
+{
+	struct iovec iov[2];
+	ssize_t retw = 1;
+	size_t siz, pad;
+	int cnt;
+
+	buf_setlinew(g_buf);
+	while likely(siz = buf_can_w(g_buf)) {
+		if (unlikely(siz < g_opts.wblk) && g_opts.strict) {
+			pad = g_opts.wblk - siz;
+			cnt = buf_fetchpad_w(g_buf, iov, siz, pad);
+			fprintf (stderr, "INFO: strict mode writer: padding with %zu 0s\n", pad);
+		} else {
+			cnt = buf_fetch_w(g_buf, iov, siz);
+			pad = 0;
+		}
+		retw = write_i(fd, iov, cnt, 0);
+		if unlikely(retw < 0) {
+			g_shm->errW = errno;
+			break;
 		}
 		if (unlikely((size_t)retw < g_opts.wblk) && g_opts.strict)
 			fprintf(stderr, "ALERT: strict mode writer wrote %zd instead of %zu\n", retw, g_opts.wblk);
+		buf_commit_w(g_buf, retw);
+		/* siz is before padding, and it's the only amount we can commit with did/got values in buf */
+		if unlikely(siz > (size_t)retw)
+			siz = retw;
+		else if (pad)
+			fd_addpad(fd, (size_t)retw - siz);
+		if unlikely(commit_wf_i(siz) < 0) {
+			g_shm->errW = errno;
+			return -1;
+		}
+	}
+#ifdef has_splice
+	if (retw >= 0 && gift_fini() < 0) {
+		g_shm->errW = errno;
+		return -1;
+	}
+#endif
+	return retw;
+}
+
+static void transfer_writer(void)
+{
+#ifndef h_mingw
+	struct iovec iov[2];
+	ssize_t retw = 1;
+	size_t siz, bat = g_opts.wbat ? g_opts.wcnt : 1;
+	int cnt;
+
+	while likely(!ACCESS_ONCE(g_shm->done)) {
+		siz = buf_can_wn(g_buf, bat);
+#ifdef has_ftx_linux
+		if (unlikely(!siz) && g_fnodata) {
+			if unlikely(!(siz = wait_ftx(g_fnodata, buf_can_w)))
+				goto outt;
+		} else
+#endif
+		if unlikely(!siz) {
+			Pm(g_vars);
+			g_shm->swait = 1;
+			full_barrier();
+			if likely(!(siz = buf_can_w(g_buf))) {
+				Vm(g_vars);
+				Pb(g_nodata);
+				if unlikely(ACCESS_ONCE(g_shm->done))
+					goto outt;
+				siz = g_shm->xwsiz;
+			} else {
+				g_shm->swait = 0;
+				Vm(g_vars);
+			}
+		}
+		cnt = buf_fetch_w(g_buf, iov, siz);
+		retw = write_i(&g_fdo, iov, cnt, siz > g_opts.wblk ? g_opts.wblk : 0);
+		if unlikely(retw < 0) {
+			g_shm->errW = errno;
+			goto outt;
+		}
+		if (unlikely((size_t)retw % g_opts.wblk) && g_opts.strict)
+			fprintf(stderr, "ALERT: strict mode writer wrote %zd, not a multiple of %zu\n", retw, g_opts.wblk);
 		/* see comments in buffer files about the split */
 		buf_commit_w(g_buf, retw);
-		Pm(g_vars);
-		buf_commit_wf(g_buf, retw);
+		if unlikely(commit_wf_i(retw) < 0) {
+			g_shm->errW = errno;
+			retw = -1;
+			goto outt;
+		}
+#ifdef has_ftx_linux
+		if (g_fnospace) {
+			ftxw_wake(g_fnospace);
+			continue;
+		}
+#endif
+		full_barrier();
 		/* wake up reader, if it's suspended due to nospace */
-		if (unlikely(g_shm->mwait) && (siz = buf_can_r(g_buf))) {
-			g_shm->mwait = 0;
-			g_shm->xrsiz = siz;
-			Vb(g_nospace);
+		if unlikely(ACCESS_ONCE(g_shm->mwait)) {
+			Pm(g_vars);
+			if (g_shm->mwait && (siz = buf_can_r(g_buf))) {
+				g_shm->mwait = 0;
+				g_shm->xrsiz = siz;
+				Vb(g_nospace);
+			}
+			Vm(g_vars);
+		}
+	}
+outt:
+	if unlikely(retw < 0) {
+		g_shm->errlog[ERR_ERR + g_role] = 1;
+		g_shm->abrt = 1;
+		g_shm->done = 1;
+		kick_crc();
+	}
+	Vb(g_nospace);
+#ifdef has_ftx_linux
+	if (g_fnospace)
+		ftxw_kick(g_fnospace);
+#endif
+	/* pairs with the barrier before reader's final done */
+	full_barrier();
+
+	/*
+	 * epilogue may be run only if reader is outside its reading loop;
+	 * otherwise we would have to sync every writer/crcer to reader and then
+	 * enter writing epilogue
+	 */
+	if (!g_shm->abrt)
+		retw = transfer_writer_epi(&g_fdo);
+/* oute: */
+	if (retw < 0) {
+		g_shm->errlog[ERR_ERR + g_role] = 1;
+	}
+#endif
+}
+
+#ifdef h_thr
+/*
+ * parallel writers - the mirror image of the parallel readers: g_opts.wpar
+ * threads reserve consecutive full blocks of data together with their
+ * offsets in the output, write them with pwritev(), and commit them in order
+ * (so did only moves over completed writes, and the durability thread's
+ * watermark stays valid); once the reader is done, whatever is left - the
+ * partial tail, strict mode pad - goes through the regular epilogue, at the
+ * matching file position
+ *
+ * a striped output (-T) has one thread per data member, taking their turns
+ * round-robin - block seq goes to member seq % n, and so does the tail
+ *
+ * with parity (-R), the parity thread sits between the reader and the data
+ * writers: it computes P (and Q) over each full row of n units as soon as the
+ * reader commits it, writes them to the parity members, and only then moves
+ * par past the row - the writers take the data up to par (see buf_can_wp());
+ * once the reader is done, the last partial row is covered (zero padded), and
+ * the parity members are closed with the trailer
+ */
+static struct {
+	pthread_mutex_t wmtx, cmtx;
+	pthread_cond_t ccv, rcv, pcv;
+	unsigned long long int seq, ticket;
+	off_t base, next;
+	size_t n, npty;
+	int fd, stop, fin, pfin;
+} g_wpar;
+
+static void wpar_abort(void)
+{
+	pthread_mutex_lock(&g_wpar.cmtx);
+	g_wpar.stop = 1;
+	pthread_cond_broadcast(&g_wpar.ccv);
+	pthread_mutex_unlock(&g_wpar.cmtx);
+	pthread_mutex_lock(&g_wpar.wmtx);
+	pthread_cond_broadcast(&g_wpar.rcv);
+	pthread_cond_broadcast(&g_wpar.pcv);
+	pthread_mutex_unlock(&g_wpar.wmtx);
+	g_shm->errlog[ERR_ERR + g_role] = 1;
+	g_shm->abrt = 1;
+	full_barrier();
+	g_shm->done = 1;
+	Vb(g_nodata);
+	Vb(g_nospace);
+#ifdef has_ftx_linux
+	if (g_fnodata) {
+		ftxw_kick(g_fnodata);
+		ftxw_kick(g_fnospace);
+	}
+#endif
+	kick_crc();
+}
+
+/*
+ * waits for the reader's data, as seen by can (called with wmtx held by the
+ * writers); 0 means it's the epilogue's turn
+ */
+static size_t wpar_data(size_t (*can)(struct buf_s *restrict))
+{
+	size_t siz;
+
+	while (!(siz = can(g_buf))) {
+		if (ACCESS_ONCE(g_shm->done))
+			return 0;
+#ifdef has_ftx_linux
+		if (g_fnodata) {
+			if (!wait_ftx(g_fnodata, can))
+				return 0;
+			continue;
+		}
+#endif
+		Pm(g_vars);
+		g_shm->swait = 1;
+		full_barrier();
+		if likely(!(siz = can(g_buf))) {
+			Vm(g_vars);
+			Pb(g_nodata);
+		} else {
+			g_shm->swait = 0;
+			Vm(g_vars);
+		}
+	}
+	return siz;
+}
+
+static ssize_t wpar_write(struct iovec *iov, int cnt, off_t off, size_t len)
+{
+	size_t tot = 0;
+	ssize_t ret;
+
+	while (tot < len) {
+		ret = pwritev(g_wpar.fd, iov, cnt, off + (off_t)tot);
+		if unlikely(ret <= 0) {
+			if (ret < 0 && errno == EINTR && !ACCESS_ONCE(g_shm->done))
+				continue;
+			if (!ret)
+				errno = EIO;
+			return -1;
+		}
+		tot += (size_t)ret;
+		iov_adv(iov, &cnt, (size_t)ret);
+	}
+	return (ssize_t)tot;
+}
+
+static void *task_wpar(void *arg)
+{
+	struct iovec iov[2];
+	unsigned long long int seq;
+	size_t siz, k = (size_t)(uintptr_t)arg;
+	ssize_t ret;
+	off_t off;
+	int cnt;
+
+	g_role = writer;
+	while (1) {
+		pthread_mutex_lock(&g_wpar.wmtx);
+		while (g_wpar.n && g_wpar.seq % g_wpar.n != k && !g_wpar.fin && !g_wpar.stop)
+			pthread_cond_wait(&g_wpar.rcv, &g_wpar.wmtx);
+		if (g_wpar.npty) {
+			while (!(siz = buf_can_wp(g_buf)) && !g_wpar.pfin && !g_wpar.stop)
+				pthread_cond_wait(&g_wpar.pcv, &g_wpar.wmtx);
+		} else if (!g_wpar.stop && !g_wpar.fin)
+			siz = wpar_data(buf_can_ws);
+		if (g_wpar.stop || g_wpar.fin || !siz) {
+			g_wpar.fin = 1;
+			if (g_wpar.n)
+				pthread_cond_broadcast(&g_wpar.rcv);
+			pthread_mutex_unlock(&g_wpar.wmtx);
+			break;
+		}
+		off = g_wpar.next;
+		g_wpar.next += (off_t)siz;
+		seq = g_wpar.seq++;
+		cnt = buf_reserve_w(g_buf, iov, siz);
+		if (g_wpar.n)
+			pthread_cond_broadcast(&g_wpar.rcv);
+		pthread_mutex_unlock(&g_wpar.wmtx);
+
+		if (g_wpar.n) {
+			if ((ret = stripe_io(g_mem[1][k], iov, cnt, siz)) >= 0 && (size_t)ret < siz)
+				errno = EIO, ret = -1;
+		} else
+			ret = wpar_write(iov, cnt, off, siz);
+		if unlikely(ret < 0) {
+			g_shm->errW = errno;
+			wpar_abort();
+			break;
+		}
+		pthread_mutex_lock(&g_wpar.cmtx);
+		while (g_wpar.ticket != seq && !g_wpar.stop)
+			pthread_cond_wait(&g_wpar.ccv, &g_wpar.cmtx);
+		pthread_mutex_unlock(&g_wpar.cmtx);
+		if unlikely(g_wpar.stop)
+			break;
+
+		buf_commit_w(g_buf, siz);
+		buf_commit_wf(g_buf, siz);
+#ifdef has_ftx_linux
+		if (g_fnospace)
+			ftxw_wake(g_fnospace);
+		else
+#endif
+		{
+			full_barrier();
+			if unlikely(ACCESS_ONCE(g_shm->mwait)) {
+				Pm(g_vars);
+				if (g_shm->mwait && (siz = buf_can_r(g_buf))) {
+					g_shm->mwait = 0;
+					g_shm->xrsiz = siz;
+					Vb(g_nospace);
+				}
+				Vm(g_vars);
+			}
+		}
+
+		pthread_mutex_lock(&g_wpar.cmtx);
+		g_wpar.ticket++;
+		pthread_cond_broadcast(&g_wpar.ccv);
+		pthread_mutex_unlock(&g_wpar.cmtx);
+	}
+	return NULL;
+}
+
+/* a full row of data past par */
+static size_t wpty_can(struct buf_s *restrict buf)
+{
+	size_t row = g_wpar.n * buf->wblk;
+
+	return ((load_acq(buf->got) - buf->par) & buf->mask) >= row ? row : 0;
+}
+
+static int wpty_put(const uint8_t *p, const uint8_t *q, size_t unit)
+{
+	struct fdpack_s **mem = g_mem[1] + g_wpar.n;
+
+	if (stripe_buf(mem[0], (void *)p, unit) != (ssize_t)unit)
+		return -1;
+	if (g_wpar.npty > 1 && stripe_buf(mem[1], (void *)q, unit) != (ssize_t)unit)
+		return -1;
+	return 0;
+}
+
+static void wpty_pub(size_t siz)
+{
+	store_rel(g_buf->par, (g_buf->par + siz) & g_buf->mask);
+	pthread_mutex_lock(&g_wpar.wmtx);
+	pthread_cond_broadcast(&g_wpar.pcv);
+	pthread_mutex_unlock(&g_wpar.wmtx);
+}
+
+/* the parity thread - see the comment at g_wpar */
+static void *task_wpty(void *arg __attribute__ ((__unused__)))
+{
+	uint8_t trl[STRIPE_TRL] = { 0 }, *p, *q;
+	size_t i, siz, rem, len[STRIPE_MAX], unit = g_opts.wblk, n = g_wpar.n;
+	unsigned long long int tot = 0;
+
+	g_role = writer;
+	if (!(p = malloc(2 * unit))) {
+		ERRG("malloc()");
+		goto err;
+	}
+	q = p + unit;
+	for (i = 0; i < n; i++)
+		len[i] = unit;
+	while (!g_wpar.stop) {
+		if (!(siz = wpar_data(wpty_can)) && !(siz = wpty_can(g_buf)))
+			break;
+		row_pq(p, g_wpar.npty > 1 ? q : NULL, g_buf->par, n, unit, len, 0);
+		if (wpty_put(p, q, unit) < 0)
+			goto err;
+		tot += siz;
+		wpty_pub(siz);
+	}
+	if (g_wpar.stop || ACCESS_ONCE(g_shm->abrt))
+		goto out;
+	/* done - the rest is less than a row */
+	if ((rem = (load_acq(g_buf->got) - g_buf->par) & g_buf->mask)) {
+		for (i = 0; i < n; i++)
+			len[i] = Y_MIN(unit, rem > i * unit ? rem - i * unit : 0);
+		row_pq(p, g_wpar.npty > 1 ? q : NULL, g_buf->par, n, unit, len, 0);
+		if (wpty_put(p, q, unit) < 0)
+			goto err;
+		tot += rem;
+		wpty_pub(rem);
+	}
+	memcpy(trl, parity_magic, sizeof parity_magic);
+	put_be(trl + 8, tot, 8);
+	for (i = 0; i < g_wpar.npty; i++) {
+		if (stripe_buf(g_mem[1][n + i], trl, sizeof trl) != sizeof trl)
+			goto err;
+	}
+	goto out;
+err:
+	g_shm->errW = errno;
+	wpar_abort();
+out:
+	pthread_mutex_lock(&g_wpar.wmtx);
+	g_wpar.pfin = 1;
+	pthread_cond_broadcast(&g_wpar.pcv);
+	pthread_mutex_unlock(&g_wpar.wmtx);
+	free(p);
+	return NULL;
+}
+
+/* returns -1 if the output is not suitable - the caller falls back to a single writer */
+static int transfer_wpar(void)
+{
+	pthread_t thr[Y_MAX(g_opts.wpar, STRIPE_MAX)];
+	struct stat st;
+	ssize_t retw = 0;
+	size_t i, n, want;
+
+	g_wpar.npty = g_nmem[1] ? g_opts.npty : 0;
+	g_wpar.n = g_nmem[1] - g_wpar.npty;
+	if (g_wpar.n)
+		want = g_wpar.n;
+	else {
+		g_wpar.fd = fd_getfd(&g_fdo);
+		if (g_fdo.type == &_fdsock || fstat(g_wpar.fd, &st) < 0 || !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+			fputs("INFO: parallel writers: output is not a regular file or a block device, using a single writer\n", stderr);
+			return -1;
+		}
+		if ((g_wpar.base = lseek(g_wpar.fd, 0, SEEK_CUR)) < 0)
+			g_wpar.base = 0;
+		want = g_opts.wpar;
+	}
+	g_wpar.next = g_wpar.base;
+	g_wpar.seq = g_wpar.ticket = 0;
+	g_wpar.stop = g_wpar.fin = g_wpar.pfin = 0;
+	pthread_mutex_init(&g_wpar.wmtx, NULL);
+	pthread_mutex_init(&g_wpar.cmtx, NULL);
+	pthread_cond_init(&g_wpar.ccv, NULL);
+	pthread_cond_init(&g_wpar.rcv, NULL);
+	pthread_cond_init(&g_wpar.pcv, NULL);
+	g_buf->wres = g_buf->par = g_buf->did;
+
+	if (g_wpar.npty) {
+		pty_init();
+		if (g_buf->size < 2 * g_wpar.n * g_opts.wblk || g_opts.wblk <= STRIPE_TRL) {
+			fprintf(stderr, "Buffer too small for parity - must hold at least 2 rows of the stripe (%zu), with the unit larger than %d.\n",
+					2 * g_wpar.n * g_opts.wblk, STRIPE_TRL);
+			want = 0;
+		}
+	}
+	for (i = 0; i < g_nmem[1] && want; i++) {
+		if (stripe_hdr_w(g_mem[1][i], i, g_nmem[1], g_wpar.npty, g_opts.wblk) < 0) {
+			g_shm->errW = errno;
+			want = 0;
+		}
+	}
+	/* data members (or just writers), then the parity thread */
+	if (want && g_wpar.npty)
+		want++;
+	for (n = 0; n < want; n++) {
+		if (pthread_create(thr + n, NULL, n < g_wpar.n || !g_wpar.n ? task_wpar : task_wpty, (void *)(uintptr_t)n)) {
+			ERRG("pthread_create()");
+			break;
+		}
+	}
+	if (!n || (n < want && g_wpar.n))
+		wpar_abort();
+	else if (g_wpar.n)
+		fprintf(stderr, "Striped output: %zu data members, %zu parity, unit %zu\n", g_wpar.n, g_wpar.npty, g_opts.wblk);
+	else
+		fprintf(stderr, "Parallel writers: %zu\n", n);
+	for (i = 0; i < n; i++)
+		pthread_join(thr[i], NULL);
+
+	pthread_cond_destroy(&g_wpar.pcv);
+	pthread_cond_destroy(&g_wpar.rcv);
+	pthread_cond_destroy(&g_wpar.ccv);
+	pthread_mutex_destroy(&g_wpar.cmtx);
+	pthread_mutex_destroy(&g_wpar.wmtx);
+
+	Vb(g_nospace);
+#ifdef has_ftx_linux
+	if (g_fnospace)
+		ftxw_kick(g_fnospace);
+#endif
+	full_barrier();
+	/* the rest continues sequentially from where the threads ended */
+	if (!g_shm->abrt) {
+		if (g_wpar.n)
+			retw = transfer_writer_epi(g_mem[1][g_wpar.seq % g_wpar.n]);
+		else if (lseek(g_wpar.fd, g_wpar.next, SEEK_SET) < 0) {
+			g_shm->errW = errno;
+			retw = -1;
+		} else
+			retw = transfer_writer_epi(&g_fdo);
+	}
+	if (retw < 0)
+		g_shm->errlog[ERR_ERR + g_role] = 1;
+	return 0;
+}
+#endif
+
+static void transfer_1cpu(void)
+{
+	struct iovec iov[2];
+	ssize_t retr = 1, retw = 0;
+	size_t siz, cnt;
+	size_t rbat = g_opts.rbat ? g_opts.rcnt : 1;
+	size_t wbat = g_opts.wbat ? g_opts.wcnt : 1;
+	int icnt;
+
+	/*
+	 * in batched mode, a single call may consume several blocks out of
+	 * the per-iteration count
+	 */
+	while likely(!ACCESS_ONCE(g_shm->done)) {
+		cnt = g_opts.rcnt;
+		while likely(cnt && (siz = buf_can_rn(g_buf, Y_MIN(rbat, cnt)))) {
+			icnt = buf_fetch_r(g_buf, iov, siz);
+			retr = read_i(&g_fdi, iov, icnt, siz > g_opts.rblk ? g_opts.rblk : 0);
+			if unlikely(retr <= 0) {
+				if (retr < 0)
+					g_shm->errR = errno;
+				goto outt;
+			}
+			buf_commit_r(g_buf, retr);
+			buf_commit_rf(g_buf, retr);
+			cnt -= Y_MIN(cnt, Y_MAX(siz / g_opts.rblk, 1));
+		}
+		cnt = g_opts.wcnt;
+		while likely(cnt && (siz = buf_can_wn(g_buf, Y_MIN(wbat, cnt)))) {
+			icnt = buf_fetch_w(g_buf, iov, siz);
+			retw = write_i(&g_fdo, iov, icnt, siz > g_opts.wblk ? g_opts.wblk : 0);
+			if unlikely(retw < 0) {
+				g_shm->errW = errno;
+				goto outt;
+			}
+			buf_commit_w(g_buf, retw);
+			if unlikely(commit_wf_i(retw) < 0) {
+				g_shm->errW = errno;
+				retw = -1;
+				goto outt;
+			}
+			if (unlikely((size_t)retw % g_opts.wblk) && g_opts.strict)
+				fprintf(stderr, "WARN: strict mode writer wrote %zd, not a multiple of %zu\n", retw, g_opts.wblk);
+			cnt -= Y_MIN(cnt, Y_MAX(siz / g_opts.wblk, 1));
+		}
+	}
+outt:
+	if (retw >= 0)
+		retw = transfer_writer_epi(&g_fdo);
+/* oute: */
+
+	if (retr < 0 || retw < 0) {
+		g_shm->errlog[ERR_ERR + g_role] = 1;
+	}
+}
+
+#ifdef has_splice
+/*
+ * splice engine - data is moved between the fds through an internal pipe,
+ * without ever entering user space; the pipe's fill level takes the role of
+ * got/did, with the same blocking and resume points semantics as the ring in
+ * transfer_1cpu(); the pipe is grown towards -m size
+ *
+ * strict mode is left to the ring - a full pipe (in pages, not bytes) can
+ * force the writer below wblk, and splice() itself may return short anyway
+ */
+static int g_spl[2] = { -1, -1 };
+static size_t g_splcap;
+
+static int splice_fdok(const struct fdpack_s *fd)
+{
+	struct stat st;
+
+	if (fd->type == &_fdsock)
+		return fd->s.np.dom == IPPROTO_TCP;
+	if (fstat(fd->fd, &st) < 0)
+		return 0;
+	return S_ISREG(st.st_mode) || S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode) || S_ISBLK(st.st_mode);
+}
+
+/* returns 0 if the engine can be used, otherwise we fall back to the ring */
+static int splice_prep(void)
+{
+	long int ret;
+
+	if (g_opts.rcrc || g_opts.wcrc) {
+		fputs("INFO: splice engine: crc requested, falling back to the ring\n", stderr);
+		return -1;
+	}
+	if (g_opts.strict) {
+		fputs("INFO: splice engine: strict mode requested, falling back to the ring\n", stderr);
+		return -1;
+	}
+	if (!splice_fdok(&g_fdi) || !splice_fdok(&g_fdo)) {
+		fputs("INFO: splice engine: unsupported input or output, falling back to the ring\n", stderr);
+		return -1;
+	}
+	if (pipe(g_spl) < 0) {
+		perror("pipe()");
+		return -1;
+	}
+	/* best effort - we may not be allowed to go above pipe-max-size */
+	for (ret = (long int)Y_MIN(g_opts.bsiz, INT_MAX); ret > 4096; ret >>= 1)
+		if (fcntl(g_spl[1], F_SETPIPE_SZ, (int)ret) >= 0)
+			break;
+	ret = fcntl(g_spl[1], F_GETPIPE_SZ);
+	if (ret < 0 || (size_t)ret <= 2*Y_MAX(g_opts.rblk, g_opts.wblk)) {
+		fputs("INFO: splice engine: pipe too small for the block sizes, falling back to the ring\n", stderr);
+		close(g_spl[0]);
+		close(g_spl[1]);
+		return -1;
+	}
+	g_splcap = (size_t)ret;
+	g_buf->path = "splice";
+	fprintf(stderr, "Splice engine, pipe size: %zu\n", g_splcap);
+	return 0;
+}
+
+static inline ssize_t
+splice_i(int fdi, int fdo, size_t siz)
+{
+	ssize_t ret;
+	do {
+		ret = splice(fdi, NULL, fdo, NULL, siz, SPLICE_F_MOVE);
+	} while (unlikely(ret < 0) && errno == EINTR && !ACCESS_ONCE(g_shm->done));
+	return ret;
+}
+
+/*
+ * the pipe's capacity is in pages, not bytes - short splices take whole
+ * slots, so it may be full before fill reaches g_splcap; as we're a single
+ * task, blocking on our own pipe would be a deadlock - so check for a free
+ * slot first
+ */
+static inline int
+splice_full(void)
+{
+	struct pollfd pfd = { .fd = g_spl[1], .events = POLLOUT };
+	return poll(&pfd, 1, 0) <= 0;
+}
+
+static void transfer_splice(void)
+{
+	ssize_t retr = 1, retw = 0;
+	size_t siz, cnt, fill = 0;
+	size_t rmin = g_opts.rline ? 1 : g_opts.rblk;
+	size_t wmin = g_opts.wline ? 1 : g_opts.wblk;
+	size_t rsp = (size_t)(g_opts.rsp * (double)g_splcap);
+	size_t wsp = (size_t)(g_opts.wsp * (double)g_splcap);
+	int ifd = fd_getfd(&g_fdi), ofd = fd_getfd(&g_fdo);
+	int rstall = 0, wstall = wsp != 0, full;
+
+	while likely(!ACCESS_ONCE(g_shm->done)) {
+		full = 0;
+		for (cnt = g_opts.rcnt; cnt; cnt--) {
+			if unlikely(rstall) {
+				if (fill > rsp)
+					break;
+				rstall = 0;
+			}
+			siz = Y_MIN(g_splcap - fill, g_opts.rblk);
+			if (siz < rmin || (fill && splice_full())) {
+				/* overrun, back off */
+				rstall = rsp != 0;
+				full = 1;
+				break;
+			}
+			retr = splice_i(ifd, g_spl[1], siz);
+			if unlikely(retr <= 0) {
+				if (retr < 0)
+					g_shm->errR = errno;
+				goto outt;
+			}
+			fill += (size_t)retr;
+			g_buf->allin += (size_t)retr;
+			g_buf->rops++;
+		}
+		for (cnt = g_opts.wcnt; cnt; cnt--) {
+			/* with the pipe full, the writer must make progress */
+			if unlikely(wstall) {
+				if (fill < wsp && !full)
+					break;
+				wstall = 0;
+			}
+			siz = Y_MIN(fill, g_opts.wblk);
+			if (!siz || (siz < wmin && !full)) {
+				/* underrun, back off */
+				wstall = wsp != 0;
+				break;
+			}
+			retw = splice_i(g_spl[0], ofd, siz);
+			if unlikely(retw < 0) {
+				g_shm->errW = errno;
+				goto outt;
+			}
+			fill -= (size_t)retw;
+			g_buf->allout += (size_t)retw;
+			g_buf->wops++;
+			full = 0;
+		}
+	}
+outt:
+	/* epilogue - analogous to transfer_writer_epi() */
+	while (retw >= 0 && fill && !g_shm->abrt) {
+		siz = Y_MIN(fill, g_opts.wblk);
+		retw = splice_i(g_spl[0], ofd, siz);
+		if unlikely(retw < 0) {
+			g_shm->errW = errno;
+			break;
+		}
+		fill -= (size_t)retw;
+		g_buf->allout += (size_t)retw;
+		g_buf->wops++;
+	}
+	close(g_spl[0]);
+	close(g_spl[1]);
+	g_spl[0] = g_spl[1] = -1;
+
+	if (retr < 0 || retw < 0) {
+		g_shm->errlog[ERR_ERR + g_role] = 1;
+	}
+}
+#endif
+
+#ifdef has_offload
+/*
+ * offload engine - regular file input, the copy is done entirely by the
+ * kernel; in order of preference:
+ * - FICLONE (reflink) - whole file, so only from the start of the input into
+ *   an empty output
+ * - copy_file_range() - file to file, possibly offloaded by the filesystem
+ *   (or the storage) itself
+ * - sendfile() - file to anything else (tcp socket, pipe), or file to file
+ *   if the above is not supported
+ * each step falls back to the next one if the very first call fails, the last
+ * one to the ring; crc, if requested, is calculated by re-reading the source
+ * with pread() into the buffer (otherwise unused here) - by a helper thread
+ * trailing the copy, so both proceed in parallel; without the thread, each
+ * chunk is re-read right after it's copied
+ */
+enum { off_cfr, off_sendfile };
+
+static inline ssize_t
+offload_i(int how, int ifd, int ofd, size_t siz)
+{
+	ssize_t ret;
+	do {
+		if (how == off_cfr)
+			ret = copy_file_range(ifd, NULL, ofd, NULL, siz, 0);
+		else
+			ret = sendfile(ofd, ifd, NULL, siz);
+	} while (unlikely(ret < 0) && errno == EINTR && !ACCESS_ONCE(g_shm->done));
+	return ret;
+}
+
+static inline int
+offload_fallback(int err)
+{
+	return err == EXDEV || err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == EBADF;
+}
+
+static int offload_crc(int fd, off_t pos, size_t siz)
+{
+	ssize_t ret;
+
+	while (siz) {
+		ret = pread(fd, g_buf->ptr, Y_MIN(siz, g_buf->size), pos);
+		if (ret <= 0) {
+			if (ret < 0)
+				g_shm->errR = errno;
+			return -1;
 		}
+		if (g_buf->dorcrc)
+			dg_calc(&g_buf->rdg, g_buf->ptr, (size_t)ret);
+		if (g_buf->dowcrc)
+			dg_calc(&g_buf->wdg, g_buf->ptr, (size_t)ret);
+		pos += ret;
+		siz -= (size_t)ret;
 	}
-	Vm(g_vars);
-outt:
-	if unlikely(retw < 0) {
-		g_shm->errlog[ERR_ERR + g_role] = 1;
-		g_shm->abrt = 1;
-		g_shm->done = 1;
+	return 0;
+}
+
+/*
+ * the helper - end is the copy's position (published by offload_crc_push()),
+ * pos is how far the crc got
+ */
+static struct {
+#ifdef h_thr
+	pthread_t thr;
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+#endif
+	off_t pos, end;
+	int fd, on, fin, err;
+} g_ocrc;
+
+#ifdef h_thr
+static void *task_ocrc(void *arg __attribute__ ((__unused__)))
+{
+	off_t pos, end;
+	int err;
+
+	pthread_mutex_lock(&g_ocrc.mtx);
+	while (1) {
+		while (g_ocrc.pos == g_ocrc.end && !g_ocrc.fin)
+			pthread_cond_wait(&g_ocrc.cv, &g_ocrc.mtx);
+		if (g_ocrc.pos == g_ocrc.end || g_ocrc.err)
+			break;
+		pos = g_ocrc.pos;
+		end = g_ocrc.end;
+		pthread_mutex_unlock(&g_ocrc.mtx);
+		err = offload_crc(g_ocrc.fd, pos, (size_t)(end - pos));
+		pthread_mutex_lock(&g_ocrc.mtx);
+		g_ocrc.err = err;
+		g_ocrc.pos = end;
 	}
-	Vb(g_nospace);
+	pthread_mutex_unlock(&g_ocrc.mtx);
+	return NULL;
+}
+#endif
 
-	/*
-	 * epilogue may be run only if reader is outside its reading loop;
-	 * otherwise we would have to sync every writer/crcer to reader and then
-	 * enter writing epilogue
-	 */
-	if (!g_shm->abrt)
-		retw = transfer_writer_epi();
-/* oute: */
-	if (retw < 0) {
-		g_shm->errlog[ERR_ERR + g_role] = 1;
+static void offload_crc_start(int fd, off_t pos)
+{
+	memset(&g_ocrc, 0, sizeof g_ocrc);
+	if (!g_buf->dorcrc && !g_buf->dowcrc)
+		return;
+	g_ocrc.fd = fd;
+	g_ocrc.pos = g_ocrc.end = pos;
+	g_ocrc.on = 1;
+#ifdef h_thr
+	int err;
+
+	pthread_mutex_init(&g_ocrc.mtx, NULL);
+	pthread_cond_init(&g_ocrc.cv, NULL);
+	if (!(err = pthread_create(&g_ocrc.thr, NULL, task_ocrc, NULL))) {
+		g_ocrc.on = 2;
+		return;
 	}
+	fprintf(stderr, "WARN: offload engine: pthread_create(): %s, crc follows the copy\n", strerror(err));
+	pthread_cond_destroy(&g_ocrc.cv);
+	pthread_mutex_destroy(&g_ocrc.mtx);
 #endif
 }
 
-static void transfer_1cpu(void)
+/* the copy got past siz more bytes */
+static int offload_crc_push(size_t siz)
 {
-	uint8_t *ptrr, *ptrw;
-	ssize_t retr = 1, retw = 0;
-	size_t siz, cnt;
+#ifdef h_thr
+	int err;
+#endif
+
+	if (!g_ocrc.on)
+		return 0;
+#ifdef h_thr
+	if (g_ocrc.on == 2) {
+		pthread_mutex_lock(&g_ocrc.mtx);
+		g_ocrc.end += (off_t)siz;
+		err = g_ocrc.err;
+		pthread_cond_signal(&g_ocrc.cv);
+		pthread_mutex_unlock(&g_ocrc.mtx);
+		return err;
+	}
+#endif
+	g_ocrc.end += (off_t)siz;
+	if (offload_crc(g_ocrc.fd, g_ocrc.pos, siz) < 0)
+		return -1;
+	g_ocrc.pos = g_ocrc.end;
+	return 0;
+}
+
+/* waits for the crc to catch up (or to give up, if abrt) */
+static int offload_crc_fini(void)
+{
+#ifdef h_thr
+	if (g_ocrc.on == 2) {
+		pthread_mutex_lock(&g_ocrc.mtx);
+		g_ocrc.fin = 1;
+		if (g_shm->abrt)
+			g_ocrc.err = -1;
+		pthread_cond_signal(&g_ocrc.cv);
+		pthread_mutex_unlock(&g_ocrc.mtx);
+		pthread_join(g_ocrc.thr, NULL);
+		pthread_cond_destroy(&g_ocrc.cv);
+		pthread_mutex_destroy(&g_ocrc.mtx);
+	}
+#endif
+	g_ocrc.on = 0;
+	return g_ocrc.err;
+}
+
+/* reflink the whole input, if it is possible at all */
+static int offload_clone(int ifd, int ofd, off_t ipos)
+{
+	struct stat sti, sto;
+
+	if (ipos || lseek(ofd, 0, SEEK_CUR) != 0)
+		return -1;
+	if (fstat(ifd, &sti) < 0 || fstat(ofd, &sto) < 0 || !S_ISREG(sto.st_mode) || sto.st_size)
+		return -1;
+	if (ioctl(ofd, FICLONE, ifd) < 0)
+		return -1;
+	lseek(ifd, sti.st_size, SEEK_SET);
+	lseek(ofd, sti.st_size, SEEK_SET);
+	g_buf->path = "offload (reflink)";
+	g_buf->allin = g_buf->allout = (unsigned long long)sti.st_size;
+	g_buf->rops = g_buf->wops = 1;
+	return 0;
+}
+
+/* returns -1 if nothing could be offloaded, and we should use the ring */
+static int transfer_offload(void)
+{
+	static const char *paths[] = {
+		[off_cfr] = "offload (copy_file_range)",
+		[off_sendfile] = "offload (sendfile)",
+	};
+	struct stat st;
+	ssize_t ret = 0;
+	size_t pad;
+	off_t ipos;
+	int ifd = fd_getfd(&g_fdi), ofd = fd_getfd(&g_fdo);
+	int how = off_cfr;
+
+	if (fstat(ifd, &st) < 0 || !S_ISREG(st.st_mode) ||
+	    (g_fdo.type == &_fdsock && g_fdo.s.np.dom != IPPROTO_TCP)) {
+		fputs("INFO: offload engine: input is not a regular file or unsupported output, falling back to the ring\n", stderr);
+		return -1;
+	}
+	if ((ipos = lseek(ifd, 0, SEEK_CUR)) < 0)
+		ipos = 0;
+
+	if (!offload_clone(ifd, ofd, ipos)) {
+		offload_crc_start(ifd, 0);
+		offload_crc_push(g_buf->allin);
+		if (offload_crc_fini() < 0)
+			goto oute;
+		goto outp;
+	}
+	if (fstat(ofd, &st) < 0 || !S_ISREG(st.st_mode))
+		how = off_sendfile;
 
+	offload_crc_start(ifd, ipos);
 	while likely(!ACCESS_ONCE(g_shm->done)) {
-		cnt = g_opts.rcnt;
-		while likely((siz = buf_can_r(g_buf)) && cnt--) {
-			ptrr = buf_fetch_r(g_buf, siz);
-			retr = read_i(&g_fdi, ptrr, siz);
-			if unlikely(retr <= 0) {
-				if (retr < 0)
-					g_shm->errR = errno;
-				goto outt;
+		ret = offload_i(how, ifd, ofd, g_buf->size);
+		if unlikely(ret < 0) {
+			if (!g_buf->allout && offload_fallback(errno)) {
+				if (how == off_cfr) {
+					how = off_sendfile;
+					continue;
+				}
+				offload_crc_fini();
+				fputs("INFO: offload engine: not supported by the kernel or the endpoints, falling back to the ring\n", stderr);
+				return -1;
 			}
-			buf_commit_r(g_buf, retr);
-			buf_commit_rf(g_buf, retr);
+			g_shm->errW = errno;
+			offload_crc_fini();
+			goto oute;
 		}
-		cnt = g_opts.wcnt;
-		while likely((siz = buf_can_w(g_buf)) && cnt--) {
-			ptrw = buf_fetch_w(g_buf, siz);
-			retw = write_i(&g_fdo, ptrw, siz);
-			if unlikely(retw < 0) {
-				g_shm->errW = errno;
-				goto outt;
+		if (!ret)
+			break;
+		if (offload_crc_push((size_t)ret) < 0) {
+			offload_crc_fini();
+			goto oute;
+		}
+		ipos += ret;
+		g_buf->allin += (size_t)ret;
+		g_buf->allout += (size_t)ret;
+		g_buf->rops++;
+		g_buf->wops++;
+	}
+	/* the pad below reuses the buffer */
+	if (offload_crc_fini() < 0)
+		goto oute;
+	g_buf->path = paths[how];
+outp:
+	pad = (size_t)(g_buf->allout % g_opts.wblk);
+	if (pad && g_opts.strict && !g_shm->abrt) {
+		/* the buffer is unused here, so it's our source of 0s */
+		pad = g_opts.wblk - pad;
+		fprintf (stderr, "INFO: strict mode writer: padding with %zu 0s\n", pad);
+		memset(g_buf->ptr, 0, pad);
+		while (pad) {
+			if ((ret = write(ofd, g_buf->ptr, pad)) <= 0) {
+				if (ret < 0 && errno == EINTR)
+					continue;
+				g_shm->errW = ret < 0 ? errno : EIO;
+				goto oute;
 			}
-			buf_commit_w(g_buf, retw);
-			buf_commit_wf(g_buf, retw);
-			if (unlikely((size_t)retw < g_opts.wblk) && g_opts.strict)
-				fprintf(stderr, "WARN: strict mode writer wrote %zd instead of %zu\n", retw, g_opts.wblk);
+			if (g_buf->dowcrc)
+				dg_calc(&g_buf->wdg, g_buf->ptr, (size_t)ret);
+			fd_addpad(&g_fdo, (size_t)ret);
+			g_buf->allout += (size_t)ret;
+			g_buf->wops++;
+			pad -= (size_t)ret;
 		}
 	}
-outt:
-	if (retw >= 0)
-		retw = transfer_writer_epi();
-/* oute: */
+	return 0;
+oute:
+	g_shm->errlog[ERR_ERR + g_role] = 1;
+	return 0;
+}
+#endif
 
-	if (retr < 0 || retw < 0) {
+#ifdef has_fmap
+/*
+ * zero copy mmap input - with no reblocking, crc or padding to do, the ring
+ * is skipped entirely, and the writer works directly on the input's mapping
+ */
+static void transfer_map(void)
+{
+	struct iovec iov;
+	const void *ptr;
+	ssize_t ret;
+	size_t siz = g_opts.wblk * (g_opts.wbat ? g_opts.wcnt : 1);
+
+	g_buf->path = "mmap (zero copy)";
+	while likely(!ACCESS_ONCE(g_shm->done)) {
+		ret = fd_map_peek(&g_fdi, &ptr, siz);
+		if unlikely(ret <= 0) {
+			if (!ret)
+				break;
+			g_shm->errR = errno;
+			goto oute;
+		}
+		iov.iov_base = (void *)ptr;
+		iov.iov_len = (size_t)ret;
+		if unlikely((ret = write_i(&g_fdo, &iov, 1, 0)) < 0) {
+			g_shm->errW = errno;
+			goto oute;
+		}
+		fd_map_skip(&g_fdi, (size_t)ret);
+		g_buf->allin += (size_t)ret;
+		g_buf->allout += (size_t)ret;
+		g_buf->rops++;
+		g_buf->wops++;
+	}
+	return;
+oute:
+	g_shm->errlog[ERR_ERR + g_role] = 1;
+}
+#endif
+
+#ifdef has_uring_linux
+/*
+ * uring engine - up to -q reads and -q writes are kept in flight at once,
+ * directly in the buffer (registered as a fixed buffer if possible)
+ *
+ * each side keeps a fifo of slots in issue order; pos is the stream position
+ * of the next request, done the position up to which everything completed -
+ * those take the roles of got/did (modulo the buffer's size); completions can
+ * arrive in any order, but are committed (crc, stats, cursors) in order only
+ *
+ * seekable endpoints (regular files, block devices) use explicit offsets, so
+ * the requests are independent; anything else is a stream - a batch of
+ * requests is linked, so they are executed in order, and no new batch is
+ * issued until the previous one completed
+ *
+ * a short result (e.g. a pipe returning what it had, or the end of a file)
+ * breaks the link - the rest of the batch is cancelled by the kernel; in any
+ * case, everything issued after a short request is drained and discarded,
+ * and the side continues from its new done position; for seekable endpoints
+ * this may repeat some reads / writes, which is harmless
+ */
+struct uslot_s {
+	unsigned long long int pos;
+	size_t len, pad;
+	ssize_t res;
+	int state;
+	struct iovec iov[2];
+};
+
+struct uside_s {
+	struct uslot_s *slot;
+	unsigned long long int pos, done, end;
+	unsigned int head, tail;
+	off_t base;
+	size_t dio;
+	int fd, wr, drain, eof;
+};
+
+static struct uring_s g_ur = { .fd = -1 };
+
+static int uring_prep(void)
+{
+	if (uringw_ctor(&g_ur, 2*(unsigned int)g_opts.qdep, g_opts.sqpoll) < 0) {
+		fputs("INFO: uring engine: io_uring is not available, falling back to the ring\n", stderr);
+		return -1;
+	}
+	if (uringw_reg(&g_ur, g_buf->ptr, g_buf->iscir ? 2*g_buf->size : g_buf->size) < 0)
+		fputs("INFO: uring engine: couldn't register the buffer, using regular ops\n", stderr);
+	g_buf->path = g_ur.fixed ? "uring (fixed buffer)" : "uring";
+	fprintf(stderr, "Uring engine, queue depth: %zu%s\n", g_opts.qdep, g_opts.sqpoll ? ", sqpoll" : "");
+	return 0;
+}
+
+static void uring_side(struct uside_s *u, struct fdpack_s *fd, int wr)
+{
+	struct stat st;
+
+	memset(u, 0, sizeof *u);
+	u->fd = fd_getfd(fd);
+	u->wr = wr;
+	u->base = -1;
+	u->dio = fd_getdio(fd);
+	if (!fstat(u->fd, &st) && (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode)))
+		u->base = lseek(u->fd, 0, SEEK_CUR);
+}
+
+static struct io_uring_sqe *
+uring_issue(struct uside_s *u, size_t siz, size_t pad)
+{
+	struct io_uring_sqe *sqe;
+	struct uslot_s *sl;
+	int cnt;
+
+	if unlikely(!(sqe = uringw_sqe(&g_ur)))
+		return NULL;
+	sl = u->slot + u->tail % g_opts.qdep;
+	sl->pos = u->pos;
+	sl->len = siz + pad;
+	sl->pad = pad;
+	sl->state = 0;
+	cnt = ibuf_iov(g_buf, sl->iov, (size_t)u->pos & g_buf->mask, siz + pad);
+	if (cnt == 1 && g_ur.fixed) {
+		sqe->opcode = u->wr ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->addr = (uintptr_t)sl->iov[0].iov_base;
+		sqe->len = (uint32_t)sl->len;
+	} else {
+		sqe->opcode = u->wr ? IORING_OP_WRITEV : IORING_OP_READV;
+		sqe->addr = (uintptr_t)sl->iov;
+		sqe->len = (uint32_t)cnt;
+	}
+	sqe->fd = u->fd;
+	sqe->off = u->base < 0 ? (uint64_t)-1 : (uint64_t)u->base + u->pos;
+	sqe->user_data = ((uint64_t)u->wr << 32) | (u->tail % g_opts.qdep);
+	if (u->base < 0)
+		sqe->flags = IOSQE_IO_LINK;
+	u->tail++;
+	u->pos += siz;
+	return sqe;
+}
+
+/* returns -1 on error, with err set */
+static int uring_commit(struct uside_s *u, int *err)
+{
+	struct uslot_s *sl;
+	size_t n;
+
+	while (u->head != u->tail && (sl = u->slot + u->head % g_opts.qdep)->state) {
+		u->head++;
+		if (u->drain)
+			continue;
+		if unlikely(sl->res < 0) {
+			*err = (int)-sl->res;
+			return -1;
+		}
+		n = (size_t)sl->res;
+		if (u->wr) {
+			if (g_buf->dowcrc)
+				ibuf_dg(g_buf, &g_buf->wdg, (size_t)sl->pos & g_buf->mask, n);
+			g_buf->allout += n;
+			g_buf->wops++;
+			if (unlikely(n < g_opts.wblk) && g_opts.strict)
+				fprintf(stderr, "WARN: strict mode writer wrote %zu instead of %zu\n", n, g_opts.wblk);
+			u->end = Y_MAX(u->end, sl->pos + n);
+			/* the pad is never committed, as in the ring */
+			if (n > sl->len - sl->pad) {
+				fd_addpad(&g_fdo, n - (sl->len - sl->pad));
+				n = sl->len - sl->pad;
+			}
+		} else {
+			if (g_buf->dorcrc)
+				ibuf_dg(g_buf, &g_buf->rdg, (size_t)sl->pos & g_buf->mask, n);
+			g_buf->allin += n;
+			g_buf->rops++;
+			u->eof = !n;
+		}
+		u->done += n;
+		if unlikely((size_t)sl->res < sl->len)
+			u->drain = 1;
+	}
+	if (u->drain && u->head == u->tail) {
+		u->drain = 0;
+		u->pos = u->done;
+	}
+	return 0;
+}
+
+static inline void
+uring_unlink(struct io_uring_sqe *sqe)
+{
+	if (sqe)
+		sqe->flags &= (uint8_t)~IOSQE_IO_LINK;
+}
+
+static void transfer_uring(void)
+{
+	struct uside_s r, w;
+	struct io_uring_sqe *sqe, *last;
+	struct io_uring_cqe *cqe;
+	struct uslot_s *sl;
+	struct iovec piov[2];
+	size_t siz, pad, q = g_opts.qdep;
+	size_t rmin = g_opts.rline ? 1 : g_opts.rblk;
+	size_t wmin = g_opts.wline ? 1 : g_opts.wblk;
+	int rstall = 0, wstall = g_buf->wsp != 0, fin, ok, err = 0, ret, i, cnt;
+
+	uring_side(&r, &g_fdi, 0);
+	uring_side(&w, &g_fdo, 1);
+	r.slot = calloc(2*q, sizeof *r.slot);
+	w.slot = r.slot + q;
+	if (!r.slot) {
+		ERRG("calloc()");
 		g_shm->errlog[ERR_ERR + g_role] = 1;
+		return;
+	}
+
+	while likely(!ACCESS_ONCE(g_shm->done)) {
+		/* streams - new batch only if the previous one is complete */
+		ok = r.base >= 0 || r.head == r.tail;
+		last = NULL;
+		while (ok && !r.eof && !r.drain && r.tail - r.head < q) {
+			if unlikely(rstall) {
+				if (r.done - w.done > g_buf->rsp)
+					break;
+				rstall = 0;
+			}
+			siz = Y_MIN(g_buf->size - 1 - (size_t)(r.pos - w.done), g_opts.rblk);
+			if (siz < rmin) {
+				/* overrun, back off */
+				rstall = g_buf->rsp != 0;
+				break;
+			}
+			if (!(sqe = uring_issue(&r, siz, 0)))
+				break;
+			last = sqe;
+		}
+		uring_unlink(last);
+
+		fin = r.eof && r.head == r.tail;
+		ok = w.base >= 0 || w.head == w.tail;
+		last = NULL;
+		while (ok && !w.drain && w.tail - w.head < q) {
+			siz = (size_t)(r.done - w.pos);
+			if unlikely(wstall) {
+				if (siz < g_buf->wsp && !fin)
+					break;
+				wstall = 0;
+			}
+			siz = Y_MIN(siz, g_opts.wblk);
+			if (!siz || (siz < wmin && !fin)) {
+				/* underrun, back off */
+				wstall = !fin && g_buf->wsp != 0;
+				break;
+			}
+			pad = 0;
+			if (unlikely(siz < g_opts.wblk) && g_opts.strict) {
+				/*
+				 * the very last write - wait until everything
+				 * else completed, so the space after the data
+				 * is really free
+				 */
+				if (w.head != w.tail)
+					break;
+				pad = g_opts.wblk - siz;
+				fprintf (stderr, "INFO: strict mode writer: padding with %zu 0s\n", pad);
+				cnt = ibuf_iov(g_buf, piov, (size_t)(w.pos + siz) & g_buf->mask, pad);
+				for (i = 0; i < cnt; i++)
+					memset(piov[i].iov_base, 0, piov[i].iov_len);
+			}
+			if (unlikely(w.dio) && (siz + pad) % w.dio) {
+				/* unaligned tail, see fd_write_f() */
+				if (w.head != w.tail)
+					break;
+				fd_nodirect(&g_fdo);
+				w.dio = 0;
+			}
+			if (!(sqe = uring_issue(&w, siz, pad)))
+				break;
+			last = sqe;
+		}
+		uring_unlink(last);
+
+		if (r.head == r.tail && w.head == w.tail) {
+			/* nothing in flight, and nothing could be issued */
+			if (!fin || w.done != r.done)
+				fputs("WARN: uring engine: stalled, giving up\n", stderr);
+			break;
+		}
+		ret = uringw_enter(&g_ur, !uringw_cqe(&g_ur));
+		if unlikely(ret < 0 && errno != EINTR) {
+			g_shm->errW = errno;
+			goto oute;
+		}
+		while ((cqe = uringw_cqe(&g_ur))) {
+			sl = (cqe->user_data >> 32 ? w.slot : r.slot) + (cqe->user_data & 0xffffffffu);
+			sl->res = cqe->res;
+			sl->state = 1;
+			uringw_seen(&g_ur);
+		}
+		if (uring_commit(&r, &err) < 0) {
+			g_shm->errR = err;
+			goto oute;
+		}
+		if (uring_commit(&w, &err) < 0) {
+			g_shm->errW = err;
+			goto oute;
+		}
+	}
+	goto out;
+oute:
+	g_shm->errlog[ERR_ERR + g_role] = 1;
+out:
+	/* in flight requests (if any) are cancelled with the ring */
+	uringw_dtor(&g_ur);
+	if (r.base >= 0)
+		lseek(r.fd, r.base + (off_t)r.done, SEEK_SET);
+	if (w.base >= 0)
+		lseek(w.fd, w.base + (off_t)w.end, SEEK_SET);
+	free(r.slot);
+}
+#endif
+
+#ifdef h_thr
+/*
+ * streaming durability (-Y) - a helper thread of the writer makes the output
+ * durable every g_opts.dint bytes while the writer keeps writing; it follows
+ * allout, so it works the same with every engine; halfway through an interval
+ * the writeback is started with sync_file_range(), at its end fdatasync()
+ * makes everything written so far durable - that's the watermark reported in
+ * the stats; once the transfer is over, only the last interval remains
+ */
+static pthread_t g_durthr;
+static sig_atomic_t g_durstop;
+static int g_durfd = -1;
+
+static void *task_durable(void *arg __attribute__ ((__unused__)))
+{
+	static const struct timespec ts = { 0, 10000000 };
+	unsigned long long int w, d = 0;
+#ifdef has_fcache
+	unsigned long long int k = 0;
+#endif
+	int stop;
+
+	while (1) {
+		stop = ACCESS_ONCE(g_durstop);
+		w = load_rlx(g_buf->allout);
+#ifdef has_fcache
+		if (w - k >= g_opts.dint / 2) {
+			sync_file_range(g_durfd, 0, 0, SYNC_FILE_RANGE_WRITE);
+			k = w;
+		}
+#endif
+		if (w - d >= g_opts.dint || (stop && w > d)) {
+			if (fdatasync(g_durfd) < 0) {
+				g_shm->errW = errno;
+				g_shm->errlog[ERR_ERR + writer] = 1;
+				break;
+			}
+			d = w;
+			store_rlx(g_shm->durable, d);
+			continue;
+		}
+		if (stop)
+			break;
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+
+static void durable_start(void)
+{
+	struct stat st;
+
+	if (!g_opts.dint)
+		return;
+	if (g_nmem[1]) {
+		fputs("INFO: durability interval doesn't apply to striped outputs\n", stderr);
+		return;
+	}
+#ifdef has_fseg
+	if (g_fdo.type == &_fdseg) {
+		fputs("INFO: durability interval doesn't apply to segmented outputs\n", stderr);
+		return;
+	}
+#endif
+	g_durfd = fd_getfd(&g_fdo);
+	if (fstat(g_durfd, &st) < 0 || !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+		fputs("INFO: durability interval applies to files and block devices only\n", stderr);
+		g_durfd = -1;
+		return;
 	}
+	g_durstop = 0;
+	if (pthread_create(&g_durthr, NULL, task_durable, NULL)) {
+		ERRG("pthread_create()");
+		g_durfd = -1;
+		return;
+	}
+	fprintf(stderr, "Durability interval: %zu\n", g_opts.dint);
+}
+
+/* must be called before the output is closed */
+static void durable_stop(void)
+{
+	if (g_durfd < 0)
+		return;
+	g_durstop = 1;
+	pthread_join(g_durthr, NULL);
+	g_durfd = -1;
 }
+#endif
 
 /*
  * in mt mode: dedicated thread for signal handling; in essence a relay for
@@ -752,12 +3368,16 @@ static void *task_sigrelay(void *arg __attribute__ ((__unused__)))
 static void *task_reader(void *arg __attribute__ ((__unused__)))
 {
 	g_role = reader;
-	if (fd_open(&g_fdi) < 0) {
+	if (open_side(0) < 0) {
 		DEB("release in reader\n");
 		release(ERR_INI);
 	} else {
-		transfer_reader();
-		fd_close(&g_fdi);
+#ifdef h_thr
+		if (!(g_opts.rpar || g_nmem[0]) || transfer_rpar() < 0)
+#endif
+			transfer_reader();
+		g_shm->elidedR = fd_getelided(&g_fdi);
+		close_side(0);
 	}
 	return NULL;
 }
@@ -765,27 +3385,82 @@ static void *task_reader(void *arg __attribute__ ((__unused__)))
 static void *task_writer(void *arg __attribute__ ((__unused__)))
 {
 	g_role = writer;
-	if (fd_open(&g_fdo) < 0) {
+	if (open_side(1) < 0) {
 		DEB("release in writer\n");
 		release(ERR_INI);
 	} else {
-		transfer_writer();
-		fd_close(&g_fdo);
+#ifdef has_splice
+		if (g_opts.gift)
+			gift_prep();
+#endif
+#ifdef h_thr
+		durable_start();
+		if (!(g_opts.wpar || g_nmem[1]) || transfer_wpar() < 0)
+#endif
+			transfer_writer();
+#ifdef h_thr
+		durable_stop();
+#endif
+		g_shm->elidedW = fd_getelided(&g_fdo);
+		close_side(1);
 	}
 	return NULL;
 }
 
+static void *task_crc(void *arg __attribute__ ((__unused__)))
+{
+	g_role = crcer;
+	transfer_crc();
+	return NULL;
+}
+
 static void task_single(void)
 {
-	int ret = -1;
+	int ret = -1, eng = -1;
 	/* role remains arbiter */
 	if (fd_open(&g_fdi) < 0)
 		goto out1;
 	if (fd_open(&g_fdo) < 0)
 		goto out2;
+#ifdef h_thr
+	durable_start();
+#endif
 
-	transfer_1cpu();
+#ifdef has_splice
+	if (g_opts.engine == eng_splice && !splice_prep()) {
+		transfer_splice();
+		eng = 0;
+	}
+#endif
+#ifdef has_offload
+	if (g_opts.engine == eng_offload)
+		eng = transfer_offload();
+#endif
+#ifdef has_uring_linux
+	if (g_opts.engine == eng_uring && !uring_prep()) {
+		transfer_uring();
+		eng = 0;
+	}
+#endif
+#ifdef has_fmap
+	if (g_opts.mapzc) {
+		transfer_map();
+		eng = 0;
+	}
+#endif
+	if (eng < 0) {
+#ifdef has_splice
+		if (g_opts.gift)
+			gift_prep();
+#endif
+		transfer_1cpu();
+	}
 	ret = 0;
+#ifdef h_thr
+	durable_stop();
+#endif
+	g_shm->elidedR = fd_getelided(&g_fdi);
+	g_shm->elidedW = fd_getelided(&g_fdo);
 	fd_close(&g_fdo);
 out2:
 	fd_close(&g_fdi);
@@ -826,6 +3501,8 @@ void reap_threads(void)
 		pthread_join(g_threads[reader], NULL);
 	if (g_threads[writer] > 0)
 		pthread_join(g_threads[writer], NULL);
+	if (g_threads[crcer] > 0)
+		pthread_join(g_threads[crcer], NULL);
 	if (g_threads[sigrelay] > 0) {
 		pthread_cancel(g_threads[sigrelay]);
 		pthread_join(g_threads[sigrelay], NULL);
@@ -865,6 +3542,18 @@ static int reaper(void)
 		fprintf(stderr, "write()/send(): %s\n", strerror(g_shm->errW));
 	fputc('\n', stderr);
 	buf_report_stats(g_buf);
+#ifdef has_ftx_linux
+	if (g_fnospace) {
+		ftxw_report(g_fnospace, "reader");
+		ftxw_report(g_fnodata, "writer");
+	}
+#endif
+#ifdef h_thr
+	if (g_opts.dint)
+		fprintf(stderr, "  durable: %llu\n", g_shm->durable);
+#endif
+	if (g_opts.rsparse || g_opts.wsparse)
+		fprintf(stderr, "  elided: %llu (read), %llu (written)\n", g_shm->elidedR, g_shm->elidedW);
 	fputc('\n', stderr);
 
 	return ret;
@@ -892,6 +3581,8 @@ int main(int argc, char **argv)
 			task_reader(0);
 		else if (g_role == writer)
 			task_writer(0);
+		else if (g_role == crcer)
+			task_crc(0);
 		else if (g_opts.mode == sp) /* implied arbiter */
 			task_single();
 